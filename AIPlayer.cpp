@@ -5,80 +5,404 @@
  *	Vasco Portilheiro, 2015
  */
 
+#include <algorithm>
+#include <chrono>
 #include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include "AIPlayer.h"
 
 const int INFINITY = 1000000;
 
-/* Helper function for minimax search */
+/* Largest value of a position whose outcome isn't known */
+const int MAX_VALUE = INFINITY / 2;
+
+/* Number of nodes between readings of the clock and the shared node count */
+const int CLOCK_INTERVAL = 1024;
+
+/* Computer players always choose their own move */
+bool AIPlayer::chooseMove(ChainReaction& game, int& row, int& col) {
+	Position move = alphaBeta(game);
+	row = move.row;
+	col = move.col;
+	return true;
+}
+
+/* Searches with the player's own budget */
 Position AIPlayer::alphaBeta(ChainReaction& game) {
-	int alpha = std::numeric_limits<int>::max();
-	Position bestMove;
-	ChainReaction originGame = game;
-	alphaBeta(game, (-1) * INFINITY, INFINITY, DEPTH, bestMove);
-	return bestMove;
+	return alphaBeta(game, defaultBudget);
+}
+
+/* Sets up the limits of the search, starts any helper threads on their
+ * own copies of the game, and runs the main thread's search on the game
+ * itself. Once the main thread is done, the helpers are stopped. The main
+ * thread starts out with the first valid move as its best, so that there is
+ * always a move to return. */
+Position AIPlayer::alphaBeta(ChainReaction& game, const SearchBudget& budget) {
+	auto start = std::chrono::steady_clock::now();
+	hasDeadline = (budget.milliseconds > 0);
+	deadline = start + std::chrono::milliseconds(budget.milliseconds);
+	nodeLimit = budget.nodes;
+	stopFlag = budget.stop;
+	sharedNodes = 0;
+	stopped = false;
+	info = SearchInfo();
+	Position bookMove;
+	if (probeBooks(game, bookMove) || solveRoot(game, bookMove)) {
+		info.milliseconds = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+		return bookMove;
+	}
+	table.newSearch();
+
+	SearchThread mainThread(game, 0);
+	game.forEachValidMove(game.currentPlayer(), [&](int row, int col) {
+		mainThread.bestMove.set(row, col);
+		return false;
+	});
+
+	std::vector<std::unique_ptr<ChainReaction> > games;
+	std::vector<std::unique_ptr<SearchThread> > helpers;
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; ++i) {
+		games.emplace_back(new ChainReaction(game));
+		helpers.emplace_back(new SearchThread(*games.back(), i));
+	}
+	for (auto& helper : helpers) {
+		SearchThread* thread = helper.get();
+		threads.emplace_back([this, thread, &budget]() {
+			iterate(*thread, budget.depth);
+		});
+	}
+
+	iterate(mainThread, budget.depth);
+	stopped = true;
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	info.depth = mainThread.depth;
+	info.score = mainThread.score;
+	info.nodes = mainThread.nodes;
+	for (auto& helper : helpers) {
+		info.nodes += helper->nodes;
+	}
+	info.milliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+	return mainThread.bestMove;
+}
+
+/* The book's move is checked before it is played, so that a book built for
+ * another game which happens to share a hash can't make the AI move wrongly */
+bool AIPlayer::probeBooks(ChainReaction& game, Position& move) {
+	int players = game.players.size();
+	for (const auto& book : books) {
+		OpeningBook::Entry entry;
+		if (!book->matches(game.rows, game.cols, players) || !book->probe(game.hash(), entry))
+			continue;
+		int row = entry.move / game.cols;
+		int col = entry.move % game.cols;
+		if (!game.isValidMove(row, col, game.currentPlayer()))
+			continue;
+		move.set(row, col);
+		info.depth = entry.depth;
+		info.score = entry.score;
+		info.fromBook = true;
+		return true;
+	}
+	return false;
+}
+
+/* Only two-player games are in the tables */
+bool AIPlayer::probeEndgames(ChainReaction& game, EndgameTable::Result& result) const {
+	if (endgames.empty() || game.players.size() != 2)
+		return false;
+	PlayerId toMove = game.playerId(game.currentPlayer());
+	for (const auto& endgame : endgames) {
+		if (endgame->probe(game.board, toMove, result))
+			return true;
+	}
+	return false;
+}
+
+/* The quickest win is best, and failing that the slowest loss, as when the
+ * table was solved */
+bool AIPlayer::solveRoot(ChainReaction& game, Position& move) {
+	EndgameTable::Result result;
+	if (!probeEndgames(game, result))
+		return false;
+	bool bestWins = false;
+	int bestDistance = -1;
+	game.forEachValidMove(game.currentPlayer(), [&](int row, int col) {
+		game.makeMove(row, col);
+		bool wins;
+		int distance = 1;
+		EndgameTable::Result child;
+		bool known = true;
+		if (game.gameOver()) {
+			wins = (game.winner == this);
+		} else if (probeEndgames(game, child)) {
+			wins = !child.win;
+			distance += child.distance;
+		} else {
+			known = false;
+		}
+		game.unmakeMove();
+		if (known && (bestDistance < 0 || (wins && (!bestWins || distance < bestDistance))
+					  || (!wins && !bestWins && distance > bestDistance))) {
+			bestWins = wins;
+			bestDistance = distance;
+			move.set(row, col);
+		}
+		return true;
+	});
+	if (bestDistance < 0)
+		return false;
+	info.depth = bestDistance;
+	info.score = bestWins ? INFINITY : (-1) * INFINITY;
+	info.fromEndgame = true;
+	return true;
+}
+
+/* Iterative deepening: searches to depth one, then two, and so on. Each
+ * iteration searches the best move of the last one first, so the best move
+ * found so far is always known, even when an iteration is stopped part way
+ * through. Only moves whose search was completed can replace it. Odd
+ * numbered helper threads skip the first depth, so that they are always a
+ * ply ahead of the others. */
+void AIPlayer::iterate(SearchThread& thread, int maxDepth) {
+	for (int depth = 1 + (thread.index % 2); depth <= maxDepth; ++depth) {
+		thread.rootDepth = depth;
+		Position iterationMove;
+		int score = alphaBeta(thread, (-1) * INFINITY, INFINITY, depth, iterationMove);
+		/* A stopped iteration's move is still the best of those searched
+		 * (starting with the previous best), so it is kept if there is one */
+		if (iterationMove.row >= 0) {
+			thread.bestMove = iterationMove;
+			thread.rootMove = thread.game.index(iterationMove.row, iterationMove.col);
+		}
+		if (isStopped(thread))
+			break;
+		thread.depth = depth;
+		thread.score = score;
+		/* No need to search deeper once the game's outcome is known */
+		if (score >= INFINITY || score <= (-1) * INFINITY)
+			break;
+	}
+}
+
+/* Sets the default budget */
+void AIPlayer::setBudget(const SearchBudget& budget) {
+	defaultBudget = budget;
+}
+
+/* Sets the evaluation weights */
+void AIPlayer::setWeights(const EvalWeights& weights) {
+	this->weights = weights;
+}
+
+/* Sets the number of threads, and gives each its own table counters */
+void AIPlayer::setThreads(int threads) {
+	numThreads = (threads < 1) ? 1 : threads;
+	table.setThreads(numThreads);
+}
+
+/* Returns the information on the last search */
+const SearchInfo& AIPlayer::lastSearch() const {
+	return info;
+}
+
+/* Resizes the transposition table */
+void AIPlayer::setHashSize(int megabytes) {
+	table.resize(megabytes);
+}
+
+/* Returns the transposition table */
+const TranspositionTable& AIPlayer::transpositionTable() const {
+	return table;
+}
+
+/* Adds a book to the list of books */
+void AIPlayer::addBook(std::shared_ptr<const OpeningBook> book) {
+	books.push_back(book);
 }
 
-int AIPlayer::alphaBeta(ChainReaction& game,
+/* Adds a table to the list of endgame tables */
+void AIPlayer::addEndgameTable(std::shared_ptr<const EndgameTable> endgame) {
+	endgames.push_back(endgame);
+}
+
+/* Positions in an endgame table are scored as won or lost straight away.
+ * Positions found in the transposition table, searched at least as deep as
+ * needed, are either returned straight away or narrow the search window.
+ * Otherwise, the best move stored for the position is searched first. */
+int AIPlayer::alphaBeta(SearchThread& thread,
 						 int alpha, int beta, int depth, Position& bestMove) {
-	if (depth == 0 || game.gameOver()){
+	ChainReaction& game = thread.game;
+	if (outOfBudget(thread))
+		return 0;
+	STAT_ADD(nodes, 1);
+	if (game.gameOver())
 		return gameValue(game);
+	EndgameTable::Result solved;
+	if (depth != thread.rootDepth && probeEndgames(game, solved))
+		return ((game.currentPlayer() == this) == solved.win) ? INFINITY : (-1) * INFINITY;
+	if (depth == 0)
+		return gameValue(game);
+
+	int alphaOrig = alpha;
+	int betaOrig = beta;
+	uint64_t key = game.hash();
+	int hashMove = -1;
+	TranspositionTable::Result stored;
+	if (table.probe(key, stored, thread.index)) {
+		hashMove = stored.move;
+		if (depth != thread.rootDepth && stored.depth >= depth) {
+			if (stored.bound == TranspositionTable::EXACT)
+				return stored.score;
+			if (stored.bound == TranspositionTable::LOWER && stored.score > alpha)
+				alpha = stored.score;
+			if (stored.bound == TranspositionTable::UPPER && stored.score < beta)
+				beta = stored.score;
+			if (beta <= alpha)
+				return stored.score;
+		}
 	}
 
-	int value;
-	/* Maximizing alpha */
-	if (game.currentPlayer() == this) {
-		value = (-1) * INFINITY;
-		/* TODO: change move search from naive index brute-forcing */
-		for (int row = 0; row < game.rows; ++row) {
-			for (int col = 0; col < game.cols; ++col) {
-				ChainReaction childGame = game;
-				if (game.currentPlayer()->move(row, col, childGame)) {
-					int childAlphaBeta = alphaBeta(childGame, alpha, beta, depth - 1, bestMove);
-					if (childAlphaBeta > value)
-						value = childAlphaBeta;
-						bestMove.set(row, col);
-					if (value > alpha)
-						alpha = value;
-					if (beta <= alpha)
-						break;
-				}
-			}
+	if (depth == thread.rootDepth && thread.rootMove >= 0)
+		hashMove = thread.rootMove;
+
+	/* Maximizing alpha, if it is this player's turn, and otherwise minimizing beta */
+	Player* player = game.currentPlayer();
+	bool maximizing = (player == this);
+	int value = maximizing ? (-1) * INFINITY : INFINITY;
+	int bestCell = -1;
+	int searched = 0;
+
+	/* Searches a single move, and returns whether to go on to the next */
+	auto searchMove = [&](int row, int col) {
+		if (!game.makeMove(row, col))
+			return true;
+		int cell = game.index(row, col);
+		++searched;
+		/* Any legal move is better than none, even a losing one */
+		if (bestCell < 0) {
+			bestCell = cell;
+			bestMove.set(row, col);
 		}
-		return value;
-	} else {
-		value = INFINITY;
-		for (int row = 0; row < game.rows; ++row) {
-			for (int col = 0; col < game.cols; ++col) {
-				ChainReaction childGame = game;
-				if (game.currentPlayer()->move(row, col, childGame)) {
-					int childAlphaBeta = alphaBeta(childGame, alpha, beta, depth - 1, bestMove);
-					if (childAlphaBeta < value) {
-						value = childAlphaBeta;
-						bestMove.set(row, col);
-					if (value < beta)
-						beta = value;
-					if (alpha >= beta)
-						break;
-					}
-				}
+		Position childMove;
+		int childAlphaBeta = alphaBeta(thread, alpha, beta, depth - 1, childMove);
+		game.unmakeMove();
+		/* The result of a stopped search is meaningless, and isn't stored */
+		if (isStopped(thread))
+			return false;
+		if (maximizing) {
+			if (childAlphaBeta > value) {
+				value = childAlphaBeta;
+				bestCell = cell;
+				bestMove.set(row, col);
+			}
+			if (value > alpha)
+				alpha = value;
+		} else {
+			if (childAlphaBeta < value) {
+				value = childAlphaBeta;
+				bestCell = cell;
+				bestMove.set(row, col);
 			}
+			if (value < beta)
+				beta = value;
 		}
+		if (alpha < beta)
+			return true;
+		STAT_CUTOFF(searched - 1);
+		return false;
+	};
+
+	/* The move from the table goes first, and is then skipped */
+	bool searchRest = true;
+	if (hashMove >= 0)
+		searchRest = searchMove(hashMove / game.cols, hashMove % game.cols);
+	if (searchRest) {
+		game.forEachValidMove(player, [&](int row, int col) {
+			if (game.index(row, col) == hashMove)
+				return true;
+			return searchMove(row, col);
+		});
+	}
+	if (isStopped(thread))
 		return value;
+
+	/* A player with nowhere to place a ball leaves the position as it is */
+	if (bestCell < 0)
+		return gameValue(game);
+
+	TranspositionTable::Bound bound = TranspositionTable::EXACT;
+	if (value <= alphaOrig)
+		bound = TranspositionTable::UPPER;
+	else if (value >= betaOrig)
+		bound = TranspositionTable::LOWER;
+	table.store(key, value, bestCell, depth, bound);
+	return value;
+}
+
+/* Every CLOCK_INTERVAL nodes, a thread adds its nodes to the shared count
+ * and checks it against the node limit, and checks the deadline and the
+ * stop flag. Once out of budget, the search stays out of budget. */
+bool AIPlayer::outOfBudget(SearchThread& thread) {
+	if (isStopped(thread))
+		return true;
+	if (++thread.nodes % CLOCK_INTERVAL == 0) {
+		uint64_t nodes = sharedNodes.fetch_add(CLOCK_INTERVAL) + CLOCK_INTERVAL;
+		if ((nodeLimit != 0 && nodes >= nodeLimit)
+			|| (hasDeadline && std::chrono::steady_clock::now() >= deadline)
+			|| (stopFlag != nullptr && stopFlag->load(std::memory_order_relaxed)))
+			stopped = true;
 	}
+	return false;
+}
+
+/* The main thread only stops once it has completed depth one, so that its
+ * best move has been searched, however soon the budget runs out */
+bool AIPlayer::isStopped(const SearchThread& thread) const {
+	return (stopped.load(std::memory_order_relaxed)
+			&& (thread.index != 0 || thread.depth > 0));
 }
 
+/* Scores each player still in the game from the evaluation terms the game
+ * keeps up to date. The AI's own score is multiplied by the number of its
+ * opponents, to be on the same scale as the sum of their scores. The value
+ * is kept well short of the value of a won or lost game. */
 int AIPlayer::gameValue(const ChainReaction& game) {
+	STAT_ADD(evaluations, 1);
+	STAT_TIMER(timer, evaluationTicks);
 	if (game.gameOver()) {
 		if (this == game.winner) {
 			return INFINITY;
 		} else {
 			return (-1) * INFINITY;
 		}
-	} else {
-		return 0;
-		// TODO: implement value based on number of balls
-		// return game.playerData[ 
 	}
-}	
+	int opponents = game.numberOfPlayers() - 1;
+	int numPlayers = game.players.size();
+	PlayerId self = game.playerId(this);
+	int value = 0;
+	for (PlayerId id = 1; id <= numPlayers; ++id) {
+		if (!game.isAlive(id))
+			continue;
+		const int* terms = &game.evalTerms[id * ChainReaction::NUM_EVAL_TERMS];
+		int score = weights.material * game.ballCounts[id]
+					+ weights.critical * terms[ChainReaction::CRITICAL_CELLS]
+					+ weights.corners * terms[ChainReaction::CORNER_CELLS]
+					+ weights.edges * terms[ChainReaction::EDGE_CELLS]
+					- weights.vulnerable * terms[ChainReaction::VULNERABLE_CELLS];
+		if (id == self) {
+			value += opponents * score;
+		} else {
+			value -= score;
+		}
+	}
+	return std::max(-MAX_VALUE, std::min(MAX_VALUE, value));
+}
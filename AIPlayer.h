@@ -1,7 +1,22 @@
 /*	AIPlayer.h
  *
  *	This extends the Player class for a game of ChainReaction to a non-human player.
- *	It uses minimax with alpha-beta pruning to search for the optimal move.
+ *	It uses minimax with alpha-beta pruning to search for the optimal move. The search
+ *	deepens iteratively, one ply at a time, until it runs out of its budget of time or
+ *	nodes, and then plays the best move found so far.
+ *
+ *	The search may run on several threads ("Lazy SMP"). Every thread searches the same
+ *	position on its own copy of the game, sharing only the transposition table, so that
+ *	results found by one thread cut short the search of the others. Helper threads
+ *	start one ply deeper every other thread, so that they spread out over the tree.
+ *	The move played is the one found by the main thread.
+ *
+ *	Before searching, the AI looks the position up in its opening books (see
+ *	OpeningBook.h), if it has any for the size of the game, and plays the book's move
+ *	without searching when the position is in one. On small boards, it may also have
+ *	endgame tables (see EndgameTable.h): a position found in one is played perfectly
+ *	without searching, and positions found in one during a search are scored as won
+ *	or lost rather than searched any further.
  *
  *	Vasco Portilheiro, 2015
  */
@@ -9,8 +24,17 @@
 #ifndef _AIPLAYER_H_
 #define _AIPLAYER_H_
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #include "ChainReaction.h"
+#include "EndgameTable.h"
+#include "OpeningBook.h"
 #include "Player.h"
+#include "TranspositionTable.h"
 
 /* Struct to hold position, consisting of a row and column */
 struct Position {
@@ -18,8 +42,8 @@ struct Position {
 	Position() : Position(-1,-1) {}
 
 	void set(int row, int col) {
-		row = row;
-		col = col;
+		this->row = row;
+		this->col = col;
 	}
 
 	int row;
@@ -27,7 +51,61 @@ struct Position {
 };
 
 /* Maximum depth of move search space */
-const int DEPTH = 10;
+const int DEPTH = 64;
+
+/* Default time the AI may take to search for a move, in milliseconds */
+const int MOVE_MILLISECONDS = 1000;
+
+/* Limits on a search for a move. The search stops at whichever it reaches
+ * first: the time limit, the number of nodes (positions) visited, or the
+ * depth. A time or node limit of zero means no limit. An alpha-beta search
+ * also stops once the stop flag, if there is one, is set (from another
+ * thread), as if it had run out of time. */
+struct SearchBudget {
+	SearchBudget(int milliseconds = MOVE_MILLISECONDS, uint64_t nodes = 0,
+				 int depth = DEPTH)
+		: milliseconds(milliseconds), nodes(nodes), depth(depth), stop(nullptr) {}
+
+	int milliseconds;
+	uint64_t nodes;
+	int depth;
+	const std::atomic<bool>* stop;
+};
+
+/* Information about the last search: the deepest search completed, its
+ * score, and the number of nodes visited (by all threads) and time taken
+ * over all depths. For a move taken from an opening book, the depth and
+ * score are those of the search that put it in the book. For a move taken
+ * from an endgame table, the depth is the number of plies left in the game. */
+struct SearchInfo {
+	SearchInfo() : depth(0), score(0), nodes(0), milliseconds(0), fromBook(false),
+				   fromEndgame(false) {}
+
+	int depth;
+	int score;
+	uint64_t nodes;
+	double milliseconds;
+	bool fromBook;
+	bool fromEndgame;
+};
+
+/* Weights of the terms of the AI's evaluation of a position. A player's
+ * value is the weighted sum of their balls on the board (material), their
+ * critical, corner and edge cells, less their vulnerable cells (see
+ * ChainReaction::EvalTerm). A position is valued as the AI's own value
+ * against the sum of its opponents'. */
+struct EvalWeights {
+	EvalWeights() : material(1), critical(2), corners(3), edges(2), vulnerable(2) {}
+
+	int material;
+	int critical;
+	int corners;
+	int edges;
+	int vulnerable;
+};
+
+/* Default size of each AI player's transposition table, in megabytes */
+const int HASH_MEGABYTES = 16;
 
 class AIPlayer : public Player {
 public:
@@ -39,19 +117,130 @@ public:
 	/* Desctructor */
 	~AIPlayer(){}
 
+	/* Searches for the best move with the player's own budget */
+	bool chooseMove(ChainReaction& game, int& row, int& col);
+
 	/* Alpha-beta pruned search for best move. Will return the move as a Position.
-	 * Takes the game for which the move is to be found. */
+	 * Takes the game for which the move is to be found, and optionally a budget
+	 * for the search (otherwise the player's own budget is used). */
 	Position alphaBeta(ChainReaction& game);
+	Position alphaBeta(ChainReaction& game, const SearchBudget& budget);
+
+	/* Sets the budget used for searches that aren't given one */
+	void setBudget(const SearchBudget& budget);
+
+	/* Sets the number of threads to search with (at least one) */
+	void setThreads(int threads);
+
+	/* Sets the weights of the evaluation of positions */
+	void setWeights(const EvalWeights& weights);
+
+	/* Returns information about the last search */
+	const SearchInfo& lastSearch() const;
+
+	/* Sets the size of the player's transposition table in megabytes,
+	 * clearing it */
+	void setHashSize(int megabytes);
+
+	/* Returns the player's transposition table, e.g. to check its hit rate */
+	const TranspositionTable& transpositionTable() const;
+
+	/* Adds an opening book to consult before searching. Books may be shared
+	 * between players, and are only consulted in games of their size. */
+	void addBook(std::shared_ptr<const OpeningBook> book);
+
+	/* Adds an endgame table to probe, in two-player games of its size */
+	void addEndgameTable(std::shared_ptr<const EndgameTable> endgame);
 
 private:
 
+	/* State of one thread of a search, which searches its own game */
+	struct SearchThread {
+		SearchThread(ChainReaction& game, int index) : game(game), index(index) {}
+
+		ChainReaction& game;
+
+		/* Thread number, where the main thread is zero */
+		int index;
+
+		/* Depth the current iteration started from, at which the best move must
+		 * be searched for rather than taken from the table */
+		int rootDepth = 0;
+
+		/* Best move from the previous iteration, as a cell index, searched first */
+		int rootMove = -1;
+
+		/* Best move found, the deepest iteration completed and its score */
+		Position bestMove;
+		int depth = 0;
+		int score = 0;
+
+		/* Nodes visited by this thread */
+		uint64_t nodes = 0;
+	};
+
+	/* Table of positions already searched, carried over from move to move */
+	TranspositionTable table{HASH_MEGABYTES};
+
+	/* Budget for searches that aren't given one */
+	SearchBudget defaultBudget;
+
+	/* Number of threads to search with */
+	int numThreads = 1;
+
+	/* Weights of the evaluation of positions */
+	EvalWeights weights;
+
+	/* Information about the last search */
+	SearchInfo info;
+
+	/* Opening books to consult before searching */
+	std::vector<std::shared_ptr<const OpeningBook> > books;
+
+	/* Endgame tables to probe, at the root and during the search */
+	std::vector<std::shared_ptr<const EndgameTable> > endgames;
+
+	/* Limits of the current search, and whether it has run out of budget.
+	 * These are shared by all threads of the search. */
+	std::chrono::steady_clock::time_point deadline;
+	bool hasDeadline = false;
+	uint64_t nodeLimit = 0;
+	const std::atomic<bool>* stopFlag = nullptr;
+	std::atomic<uint64_t> sharedNodes{0};
+	std::atomic<bool> stopped{false};
+
+	/* Looks the game's position up in the opening books. Returns true and
+	 * sets the move if a book has a valid move for it. */
+	bool probeBooks(ChainReaction& game, Position& move);
+
+	/* Looks the game's position up in the endgame tables. Returns true and
+	 * fills in the result, for the player to move, if a table has it. */
+	bool probeEndgames(ChainReaction& game, EndgameTable::Result& result) const;
+
+	/* Picks the best move of a position in the endgame tables by probing
+	 * the position each move leads to. Returns false if there is none. */
+	bool solveRoot(ChainReaction& game, Position& move);
+
+	/* Runs iterative deepening on a single thread, until it runs out of budget,
+	 * reaches the maximum depth, or finds the outcome of the game */
+	void iterate(SearchThread& thread, int maxDepth);
+
 	/* Recursive alpha-beta pruned minimax search, takes the information from the public
 	 * helper funciton, the player's whose turn is being examined and a Position which,
-	 * it modifies with the best available move */
-	int alphaBeta(ChainReaction& game, int alpha, int beta,
+	 * it modifies with the best available move. Moves are made and taken back on the
+	 * thread's game itself, which is left as it was found. */
+	int alphaBeta(SearchThread& thread, int alpha, int beta,
 				   int depth, Position& bestMove);
 
-	/* Returns the heuristic value of a given game state */
+	/* Counts a node, and checks whether the search is out of budget. (The
+	 * clock and the node limit are only checked every so many nodes.) */
+	bool outOfBudget(SearchThread& thread);
+
+	/* Returns whether the given thread should stop searching */
+	bool isStopped(const SearchThread& thread) const;
+
+	/* Returns the heuristic value of a given game state, in constant time
+	 * (for a given number of players) */
 	int gameValue(const ChainReaction& game);
 
 };
@@ -0,0 +1,342 @@
+/*	BatchGame.cpp
+ *
+ *	Implements lockstep play on many boards at once. See BatchGame.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "BatchGame.h"
+#include "ChainReaction.h"
+
+/* Number of boards worked on at once, as a vector of one byte per board.
+ * Vectors are loaded and stored with memcpy, which compiles to unaligned
+ * vector moves, so the planes need no particular alignment. */
+const int LANES = 16;
+typedef uint8_t Lanes __attribute__((vector_size(LANES)));
+static_assert(LANES == 2 * sizeof(uint64_t), "mark() tests lanes as two words");
+
+static inline Lanes loadLanes(const uint8_t* address) {
+	Lanes lanes;
+	memcpy(&lanes, address, sizeof(lanes));
+	return lanes;
+}
+
+static inline void storeLanes(uint8_t* address, Lanes lanes) {
+	memcpy(address, &lanes, sizeof(lanes));
+}
+
+static inline Lanes splat(uint8_t value) {
+	Lanes lanes = {};
+	return lanes + value;
+}
+
+/* Maximum number of waves a chain reaction may take before it is assumed
+ * never to end, as in ChainReaction */
+static int maxWaves(const Board& board) {
+	return 16 * board.size() + 256;
+}
+
+/* Constructor lays out the planes for the boards, and lists the neighbours
+ * of each cell once for all of them */
+BatchGame::BatchGame(int rows, int cols, int players, int boards) :
+					 layout(rows, cols), numPlayers(players), numBoards(boards),
+					 stride((boards + LANES - 1) / LANES * LANES),
+					 ballPlane(rows * cols * stride), ownerPlane(rows * cols * stride),
+					 firePlane(rows * cols * stride),
+					 neighbourList(rows * cols * MAX_NEIGHBOURS), neighbourCount(rows * cols),
+					 current(stride), alive(stride), moved(stride), winners(stride),
+					 totalBalls(stride), mover(stride), active(stride),
+					 canEliminate(stride), othersLeft(stride), fired(stride),
+					 present(stride), scratch(stride), results(stride) {
+	for (int cell = 0; cell < layout.size(); ++cell) {
+		neighbourCount[cell] = layout.neighbours(cell, &neighbourList[cell * MAX_NEIGHBOURS]);
+	}
+	reset();
+}
+
+/* Every board starts empty, with the first player to move */
+void BatchGame::reset() {
+	std::fill(ballPlane.begin(), ballPlane.end(), 0);
+	std::fill(ownerPlane.begin(), ownerPlane.end(), NO_PLAYER);
+	std::fill(firePlane.begin(), firePlane.end(), 0);
+	uint8_t everyone = (1u << numPlayers) - 1;
+	for (int board = 0; board < stride; ++board) {
+		current[board] = 1;
+		alive[board] = everyone;
+		moved[board] = 0;
+		winners[board] = (numPlayers == 1) ? 1 : NO_PLAYER;
+		totalBalls[board] = 0;
+		active[board] = 0;
+		results[board] = MoveResult();
+	}
+}
+
+/* The players of the game are numbered in the order it was given them */
+void BatchGame::load(int board, const ChainReaction& game) {
+	for (int cell = 0; cell < size(); ++cell) {
+		ballPlane[cell * stride + board] = game.board.balls(cell);
+		ownerPlane[cell * stride + board] = game.board.owner(cell);
+	}
+	alive[board] = game.aliveMask;
+	moved[board] = game.movedMask;
+	current[board] = game.current;
+	winners[board] = game.gameOver() ? current[board] : NO_PLAYER;
+	totalBalls[board] = game.totalBalls;
+	results[board] = MoveResult();
+}
+
+int BatchGame::numberOfBalls(int board, PlayerId player) const {
+	int balls = 0;
+	for (int cell = 0; cell < size(); ++cell) {
+		if (owner(board, cell) == player)
+			balls += this->balls(board, cell);
+	}
+	return balls;
+}
+
+/* Players may place balls in empty cells and in their own */
+bool BatchGame::isValidMove(int board, int cell) const {
+	PlayerId cellOwner = owner(board, cell);
+	return (cellOwner == NO_PLAYER || cellOwner == current[board]);
+}
+
+/* Places the balls one board at a time, then resolves every chain reaction
+ * together. Before each wave, a board stops if its mover has captured every
+ * ball, or if it has run into the limit on waves, as in ChainReaction; the
+ * marks of a board that stops are taken back before the balls are spread. */
+void BatchGame::step(const int* moves) {
+	bool anyActive = false;
+	for (int board = 0; board < numBoards; ++board) {
+		results[board] = MoveResult();
+		active[board] = 0;
+		int cell = moves[board];
+		if (gameOver(board) || cell < 0 || cell >= size() || !isValidMove(board, cell))
+			continue;
+		PlayerId player = current[board];
+		results[board].played = true;
+		mover[board] = player;
+		int index = cell * stride + board;
+		++ballPlane[index];
+		ownerPlane[index] = player;
+		moved[board] |= 1u << (player - 1);
+		++totalBalls[board];
+		canEliminate[board] = ((alive[board] & ~moved[board]) == 0);
+		othersLeft[board] = 1;
+		if (layout.capacity(cell) != 0 && ballPlane[index] >= layout.capacity(cell)) {
+			bool settles = (totalBalls[board] <= layout.stableBalls());
+			if (!settles && !canEliminate[board]) {
+				results[board].saturated = true;
+			} else {
+				active[board] = 1;
+				anyActive = true;
+			}
+		}
+	}
+
+	int waveLimit = maxWaves(layout);
+	while (anyActive) {
+		mark();
+		anyActive = false;
+		for (int board = 0; board < numBoards; ++board) {
+			if (!active[board])
+				continue;
+			MoveResult& result = results[board];
+			if (fired[board] == 0) {
+				active[board] = 0;
+			} else if (canEliminate[board] && !othersLeft[board]) {
+				result.eliminated = true;
+				active[board] = 0;
+				unmark(board);
+			} else if (result.waves == waveLimit) {
+				result.saturated = true;
+				active[board] = 0;
+				unmark(board);
+			} else {
+				++result.waves;
+				result.explosions += fired[board];
+				anyActive = true;
+			}
+		}
+		if (anyActive)
+			spread();
+	}
+
+	findPresent();
+	for (int board = 0; board < numBoards; ++board) {
+		if (results[board].played)
+			updatePlayers(board);
+	}
+}
+
+/* Rejection sampling: a random cell is drawn until a valid one comes up,
+ * which picks every valid move with the same chance. Boards where few
+ * cells are valid fall back to counting them. */
+void BatchGame::randomMoves(int* moves, uint64_t& random) const {
+	for (int board = 0; board < numBoards; ++board) {
+		moves[board] = -1;
+		if (gameOver(board))
+			continue;
+		for (int tries = 0; tries < 16 && moves[board] < 0; ++tries) {
+			random ^= random >> 12;
+			random ^= random << 25;
+			random ^= random >> 27;
+			int cell = (random * 0x2545f4914f6cdd1dULL >> 32) % size();
+			if (isValidMove(board, cell))
+				moves[board] = cell;
+		}
+		if (moves[board] >= 0)
+			continue;
+		int count = 0;
+		for (int cell = 0; cell < size(); ++cell) {
+			count += isValidMove(board, cell);
+		}
+		if (count == 0)
+			continue;
+		int k = (random >> 32) % count;
+		for (int cell = 0; cell < size(); ++cell) {
+			if (isValidMove(board, cell) && k-- == 0) {
+				moves[board] = cell;
+				break;
+			}
+		}
+	}
+}
+
+/* Steps until no board is left playing */
+int BatchGame::playOut(uint64_t& random, int maxSteps) {
+	std::vector<int> moves(numBoards);
+	int steps = 0;
+	while (steps < maxSteps) {
+		bool playing = false;
+		for (int board = 0; board < numBoards && !playing; ++board) {
+			playing = !gameOver(board);
+		}
+		if (!playing)
+			break;
+		randomMoves(moves.data(), random);
+		step(moves.data());
+		++steps;
+	}
+	return steps;
+}
+
+/* ===== Private Functions =====*/
+
+/* A cell is marked on a board when the board is active and the cell is at
+ * capacity. Boards that aren't active never have marks left over (see step()),
+ * so only vectors of boards with an active one among them are gone over,
+ * here and in spread(). The marks of each board are added up a byte at a
+ * time, into counts that are moved to fired[] before they can overflow. */
+void BatchGame::mark() {
+	activeOffsets.clear();
+	for (int offset = 0; offset < stride; offset += LANES) {
+		Lanes lanes = loadLanes(&active[offset]);
+		uint64_t halves[2];
+		memcpy(halves, &lanes, sizeof(halves));
+		if (halves[0] | halves[1])
+			activeOffsets.push_back(offset);
+	}
+	std::fill(fired.begin(), fired.end(), 0);
+	std::fill(scratch.begin(), scratch.end(), 0);
+	int cellsCounted = 0;
+	for (int cell = 0; cell < size(); ++cell) {
+		uint8_t capacity = layout.capacity(cell);
+		Lanes capacityLanes = splat(capacity);
+		Lanes explodes = splat(capacity == 0 ? 0 : 1);
+		for (int offset : activeOffsets) {
+			int index = cell * stride + offset;
+			Lanes balls = loadLanes(&ballPlane[index]);
+			Lanes full = (Lanes)(balls >= capacityLanes);
+			Lanes fire = full & loadLanes(&active[offset]) & explodes;
+			storeLanes(&firePlane[index], fire);
+			storeLanes(&scratch[offset], loadLanes(&scratch[offset]) + fire);
+		}
+		if (++cellsCounted == 255 || cell == size() - 1) {
+			for (int board = 0; board < stride; ++board) {
+				fired[board] += scratch[board];
+			}
+			std::fill(scratch.begin(), scratch.end(), 0);
+			cellsCounted = 0;
+		}
+	}
+}
+
+/* Each cell loses its capacity in balls if it is marked, and gains a ball
+ * for each marked neighbour. Cells that gain any go to the board's mover;
+ * cells left empty go to no one. */
+void BatchGame::spread() {
+	std::fill(scratch.begin(), scratch.end(), 0);
+	for (int cell = 0; cell < size(); ++cell) {
+		Lanes capacityLanes = splat(layout.capacity(cell));
+		const int* next = &neighbourList[cell * MAX_NEIGHBOURS];
+		int count = neighbourCount[cell];
+		for (int offset : activeOffsets) {
+			int index = cell * stride + offset;
+			Lanes received = Lanes();
+			for (int i = 0; i < count; ++i) {
+				received += loadLanes(&firePlane[next[i] * stride + offset]);
+			}
+			Lanes fire = loadLanes(&firePlane[index]);
+			Lanes balls = loadLanes(&ballPlane[index]) - fire * capacityLanes + received;
+			Lanes owners = loadLanes(&ownerPlane[index]);
+			Lanes movers = loadLanes(&mover[offset]);
+			Lanes captured = (Lanes)(received != 0);
+			Lanes kept = ~(Lanes)(balls == 0) & owners;
+			owners = (captured & movers) | (~captured & kept);
+			storeLanes(&ballPlane[index], balls);
+			storeLanes(&ownerPlane[index], owners);
+			Lanes others = (Lanes)(owners != 0) & (Lanes)(owners != movers);
+			storeLanes(&scratch[offset], loadLanes(&scratch[offset]) | others);
+		}
+	}
+	for (int board = 0; board < stride; ++board) {
+		othersLeft[board] = (scratch[board] != 0);
+	}
+}
+
+void BatchGame::unmark(int board) {
+	for (int cell = 0; cell < size(); ++cell) {
+		firePlane[cell * stride + board] = 0;
+	}
+}
+
+/* Ors together the bit of each cell's owner, one player at a time */
+void BatchGame::findPresent() {
+	std::fill(present.begin(), present.end(), 0);
+	for (int cell = 0; cell < size(); ++cell) {
+		for (int offset = 0; offset < stride; offset += LANES) {
+			Lanes owners = loadLanes(&ownerPlane[cell * stride + offset]);
+			Lanes mask = loadLanes(&present[offset]);
+			for (int player = 1; player <= numPlayers; ++player) {
+				mask |= (Lanes)(owners == splat(player)) & splat(1u << (player - 1));
+			}
+			storeLanes(&present[offset], mask);
+		}
+	}
+}
+
+/* A chain reaction that could never end hands the game to the mover.
+ * Otherwise players who have moved and have no balls are knocked out, and
+ * the move passes to the next player left after the mover. */
+void BatchGame::updatePlayers(int board) {
+	PlayerId player = mover[board];
+	uint8_t left;
+	if (results[board].saturated)
+		left = 1u << (player - 1);
+	else
+		left = alive[board] & (present[board] | ~moved[board]);
+	results[board].eliminatedPlayers = alive[board] & ~left;
+	alive[board] = left;
+	for (int i = 1; i <= numPlayers; ++i) {
+		PlayerId next = (player - 1 + i) % numPlayers + 1;
+		if (left & (1u << (next - 1))) {
+			current[board] = next;
+			break;
+		}
+	}
+	if ((left & (left - 1)) == 0)
+		winners[board] = current[board];
+}
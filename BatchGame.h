@@ -0,0 +1,172 @@
+/*	BatchGame.h
+ *
+ *	This plays many games of ChainReaction on boards of the same size at once, in
+ *	lockstep, for playouts and for generating games in bulk. Rather than a game object
+ *	per board, the boards are stored "across": for each cell, the balls (and owners) of
+ *	that cell on every board are next to each other in memory. Each step plays one
+ *	move on every board, and the chain reactions of all boards are then resolved
+ *	together, a wave at a time (see WaveBoard.h), with each pass over the cells
+ *	working on 16 boards at a time with vector instructions.
+ *
+ *	The rules are those of ChainReaction: a player is eliminated once they have moved
+ *	and have no balls left, the game is won by the last player left (or by the player
+ *	whose chain reaction could never end), and the moving player wins outright as soon
+ *	as they hold every ball on the board. Players are numbered from one, by PlayerId,
+ *	and move in that order, each move passing to the next player still in the game.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _BATCHGAME_H_
+#define _BATCHGAME_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Board.h"
+
+class ChainReaction;
+
+class BatchGame {
+public:
+
+	/* Outcome of the last move on a board: whether a move was played, the
+	 * explosions and waves of its chain reaction, and whether that was cut
+	 * short because the mover captured every ball ("eliminated"), or because
+	 * it could never end ("saturated"), as in ChainReaction::CascadeStats.
+	 * The players knocked out of the game by the move are given as a mask,
+	 * with bit (id - 1) set for each PlayerId. */
+	struct MoveResult {
+		MoveResult() : played(false), explosions(0), waves(0), eliminated(false),
+					   saturated(false), eliminatedPlayers(0) {}
+		bool played;
+		int explosions;
+		int waves;
+		bool eliminated;
+		bool saturated;
+		uint8_t eliminatedPlayers;
+	};
+
+	/* Constructor creates the given number of empty boards, each for a game
+	 * between the given number of players (at most eight) */
+	BatchGame(int rows, int cols, int players, int boards);
+
+	/* Empties every board, starting a new game on each */
+	void reset();
+
+	/* Copies the position of a game, which must be between as many players
+	 * as the batch is for, and on a board of the same size, to a board */
+	void load(int board, const ChainReaction& game);
+
+	/* Number of boards, and the size of each */
+	int numberOfBoards() const { return numBoards; }
+	int rows() const { return layout.rows(); }
+	int cols() const { return layout.cols(); }
+	int size() const { return layout.size(); }
+
+	/* State of the game on a board */
+	PlayerId currentPlayer(int board) const { return current[board]; }
+	bool gameOver(int board) const { return winners[board] != NO_PLAYER; }
+	PlayerId winner(int board) const { return winners[board]; }
+	int moves(int board) const { return totalBalls[board]; }
+
+	/* Mask of the players still in the game on a board, bit (id - 1) for each */
+	uint8_t playersLeft(int board) const { return alive[board]; }
+
+	/* Contents of a cell on a board */
+	uint8_t balls(int board, int cell) const { return ballPlane[cell * stride + board]; }
+	PlayerId owner(int board, int cell) const { return ownerPlane[cell * stride + board]; }
+
+	/* Returns the number of balls a player has on a board */
+	int numberOfBalls(int board, PlayerId player) const;
+
+	/* Returns whether the current player of a board may place a ball in a cell */
+	bool isValidMove(int board, int cell) const;
+
+	/* Plays a move on every board: the ball is placed in cell moves[b] of
+	 * board b. Boards whose game is over, or whose move is -1 or not valid,
+	 * are left as they are. */
+	void step(const int* moves);
+
+	/* Returns the outcome of the last step on a board */
+	const MoveResult& lastMove(int board) const { return results[board]; }
+
+	/* Picks a random valid move for each board, or -1 for boards whose game
+	 * is over, using the given xorshift state */
+	void randomMoves(int* moves, uint64_t& random) const;
+
+	/* Plays random moves on every board until every game is over, or the given
+	 * number of steps have been played. Returns the number of steps. */
+	int playOut(uint64_t& random, int maxSteps);
+
+private:
+
+	/* Board of the size being played on, for its capacities and neighbours */
+	Board layout;
+	int numPlayers;
+	int numBoards;
+
+	/* Distance between a cell on a board and the same cell on the next board:
+	 * the number of boards, rounded up to a whole number of vectors */
+	int stride;
+
+	/* Planes of balls and owners, and the marks of the cells exploding in the
+	 * current wave, each size() * stride long */
+	std::vector<uint8_t> ballPlane;
+	std::vector<uint8_t> ownerPlane;
+	std::vector<uint8_t> firePlane;
+
+	/* Neighbours of each cell, MAX_NEIGHBOURS to a cell, and how many */
+	std::vector<int> neighbourList;
+	std::vector<int> neighbourCount;
+
+	/* State of each board, stride long: the player to move, the masks of the
+	 * players left and of those who have moved, the winner, and the number of
+	 * balls on the board */
+	std::vector<PlayerId> current;
+	std::vector<uint8_t> alive;
+	std::vector<uint8_t> moved;
+	std::vector<PlayerId> winners;
+	std::vector<int> totalBalls;
+
+	/* State of the chain reaction of each board during a step: the mover,
+	 * whether the board is still resolving its chain reaction, whether it may
+	 * eliminate the other players, whether any of them have balls left, and
+	 * the number of cells exploding in the current wave */
+	std::vector<PlayerId> mover;
+	std::vector<uint8_t> active;
+	std::vector<uint8_t> canEliminate;
+	std::vector<uint8_t> othersLeft;
+	std::vector<int> fired;
+
+	/* Mask of the players with balls on each board, after a step */
+	std::vector<uint8_t> present;
+
+	/* Counts or flags of each board, for the passes over the planes */
+	std::vector<uint8_t> scratch;
+
+	/* Offsets of the vectors of boards with an active board among them */
+	std::vector<int> activeOffsets;
+
+	std::vector<MoveResult> results;
+
+	/* Marks the cells at capacity on the active boards, and counts them */
+	void mark();
+
+	/* Explodes the marked cells, and notes which boards still have balls of
+	 * players other than the mover */
+	void spread();
+
+	/* Removes the marks of a board */
+	void unmark(int board);
+
+	/* Finds the players with balls on each board */
+	void findPresent();
+
+	/* Knocks out the players with no balls left, and passes the move on,
+	 * after a move on the given board */
+	void updatePlayers(int board);
+
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*	Board.cpp
+ *
+ *	Implements the flat board storage for ChainReaction. See Board.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include "Board.h"
+
+/* Constructor allocates the three planes in one buffer. The ball and owner
+ * planes start out zeroed (empty cells), and the capacity of each cell is
+ * the number of cells non-diagonally adjacent to it. Each cell can hold
+ * one ball less than its capacity without exploding. */
+Board::Board(int rows, int cols) : numRows(rows), numCols(cols),
+								   numCells(rows * cols), maxStableBalls(0),
+								   shape(nullptr), data(3 * rows * cols, 0) {
+	for (int row = 0; row < rows; ++row) {
+		for (int col = 0; col < cols; ++col) {
+			int capacity = 0;
+			capacity += (row > 0) + (row < rows - 1);
+			capacity += (col > 0) + (col < cols - 1);
+			data[2 * numCells + index(row, col)] = capacity;
+			if (capacity > 0)
+				maxStableBalls += capacity - 1;
+		}
+	}
+}
+
+/* The capacity plane is copied from the topology's table of capacities */
+Board::Board(const Topology& topology) : numRows(topology.rows()), numCols(topology.cols()),
+										 numCells(topology.size()), maxStableBalls(0),
+										 shape(&topology), data(3 * topology.size(), 0) {
+	for (int cell = 0; cell < numCells; ++cell) {
+		int capacity = topology.capacity(cell);
+		data[2 * numCells + cell] = capacity;
+		if (capacity > 0)
+			maxStableBalls += capacity - 1;
+	}
+}
@@ -0,0 +1,193 @@
+/*	Board.h
+ *
+ *	This is the storage for the board of a ChainReaction game. Instead of a graph of
+ *	individually allocated nodes, the board is kept as packed, contiguous arrays
+ *	("planes") with one byte per cell: the number of balls in the cell, the id of the
+ *	player whose balls they are, and the capacity of the cell. All three planes live in
+ *	a single buffer, so copying a board is a single memcpy.
+ *
+ *	Cells are addressed by a one-dimensional index, (row * cols) + col. On the plain
+ *	grid, neighbours are not stored, but computed from that index, and the capacity
+ *	plane is filled in from the coordinates of each cell when the board is created.
+ *	Boards of other shapes, or under other rules, are made from a Topology (see
+ *	Topology.h), which lists the neighbours of each cell and gives their capacities.
+ *
+ *	The code that changes cells finds their neighbours through a layout, which it is
+ *	specialized on: DynamicLayout for a plain grid of any size, FixedLayout for plain
+ *	grids of a size known at compile time, for which the neighbours of a cell are
+ *	found with constant dimensions, without a division by the number of columns or a
+ *	loop, and CsrLayout for boards made from a topology. A layout also gives the
+ *	number of balls an exploding cell gives away, which CsrLayout takes from the
+ *	rule policy it is specialized on in turn.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _BOARD_H_
+#define _BOARD_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Topology.h"
+
+/* Small integer id for a player, as stored in the owner plane of the board.
+ * Players are numbered from one, in the order they were given to the game,
+ * so that zero can stand for an empty cell. */
+typedef uint8_t PlayerId;
+const PlayerId NO_PLAYER = 0;
+
+/* Maximum number of players in a game, so that a set of players fits in a
+ * byte, with bit (id - 1) standing for each PlayerId */
+const int MAX_PLAYERS = 8;
+
+/* Maximum number of neighbours a cell of the plain grid can have */
+const int MAX_NEIGHBOURS = 4;
+
+class Board {
+public:
+
+	/* Constructor creates an empty board of the given dimensions */
+	Board(int rows, int cols);
+
+	/* Constructor creates an empty board of the given topology, which must
+	 * outlive the board */
+	Board(const Topology& topology);
+
+	/* Number of rows, columns, and cells on the board */
+	int rows() const { return numRows; }
+	int cols() const { return numCols; }
+	int size() const { return numCells; }
+
+	/* The topology the board was made from, or null for the plain grid */
+	const Topology* topology() const { return shape; }
+
+	/* The most balls the board can hold without any cell being at capacity.
+	 * A chain reaction on a board with more balls than this can never end. */
+	int stableBalls() const { return maxStableBalls; }
+
+	/* Returns the one-dimensional index of the cell at the given coordinates */
+	int index(int row, int col) const { return (row * numCols) + col; }
+
+	/* Return whether a position is in bounds (on the board) */
+	bool isInBounds(int row, int col) const {
+		return ((0 <= row && row < numRows) && (0 <= col && col < numCols));
+	}
+
+	/* Accessors for the planes of the board, by cell index */
+	uint8_t& balls(int cell) { return data[cell]; }
+	uint8_t balls(int cell) const { return data[cell]; }
+	PlayerId& owner(int cell) { return data[numCells + cell]; }
+	PlayerId owner(int cell) const { return data[numCells + cell]; }
+	uint8_t capacity(int cell) const { return data[2 * numCells + cell]; }
+
+	/* Returns whether the cell holds enough balls to explode. Cells with no
+	 * neighbours (on a 1x1 board) have no capacity, and never explode. */
+	bool atCapacity(int cell) const {
+		return (capacity(cell) != 0 && balls(cell) >= capacity(cell));
+	}
+
+	/* Writes the indices of the cells adjacent to the given one on the plain
+	 * grid into the given array (which must hold MAX_NEIGHBOURS entries), and
+	 * returns how many there are. Neighbours are listed above, left, below,
+	 * then right. */
+	int neighbours(int cell, int* out) const {
+		int row = cell / numCols;
+		int col = cell - (row * numCols);
+		int count = 0;
+		if (row > 0)
+			out[count++] = cell - numCols;
+		if (col > 0)
+			out[count++] = cell - 1;
+		if (row < numRows - 1)
+			out[count++] = cell + numCols;
+		if (col < numCols - 1)
+			out[count++] = cell + 1;
+		return count;
+	}
+
+private:
+
+	int numRows;
+	int numCols;
+	int numCells;
+	int maxStableBalls;
+	const Topology* shape;
+
+	/* Ball, owner and capacity planes, in that order, each numCells long */
+	std::vector<uint8_t> data;
+
+};
+
+/* Layout of a plain grid of any size, calling visit(next) for each neighbour
+ * of a cell, in the order of Board::neighbours(). On the plain grid, a cell's
+ * capacity is its number of neighbours, so an exploding cell gives away all
+ * the balls it explodes with. */
+struct DynamicLayout {
+	static const bool PLAIN_GRID = true;
+
+	static int spill(const Board& board, int cell) { return board.capacity(cell); }
+
+	template <typename Visit>
+	static void forEachNeighbour(const Board& board, int cell, Visit visit) {
+		int next[MAX_NEIGHBOURS];
+		int count = board.neighbours(cell, next);
+		for (int i = 0; i < count; ++i)
+			visit(next[i]);
+	}
+};
+
+/* Layout of a board of R rows and C columns only. The checks for each
+ * neighbour are written out rather than looped over, and with R and C
+ * constant, the column of a cell is found without a division. */
+template <int R, int C>
+struct FixedLayout {
+	static const bool PLAIN_GRID = true;
+
+	static int spill(const Board& board, int cell) { return board.capacity(cell); }
+
+	template <typename Visit>
+	static void forEachNeighbour(const Board&, int cell, Visit visit) {
+		int col = cell % C;
+		if (cell >= C)
+			visit(cell - C);
+		if (col > 0)
+			visit(cell - 1);
+		if (cell < (R - 1) * C)
+			visit(cell + C);
+		if (col < C - 1)
+			visit(cell + 1);
+	}
+};
+
+/* Rule policies, giving the number of balls an exploding cell of a board
+ * made from a topology gives away. Under the standard rule, that is all the
+ * balls it explodes with, its capacity. Under fixed capacity, it is one for
+ * each neighbour, and the cell keeps the rest. */
+struct NeighbourCapacityRule {
+	static int spill(const Board& board, int cell) { return board.capacity(cell); }
+};
+
+struct FixedCapacityRule {
+	static int spill(const Board& board, int cell) { return board.topology()->degree(cell); }
+};
+
+/* Layout of a board made from a topology, visiting the neighbours of a cell
+ * off its topology's flat list, and under the given rule policy */
+template <typename Rule>
+struct CsrLayout {
+	static const bool PLAIN_GRID = false;
+
+	static int spill(const Board& board, int cell) { return Rule::spill(board, cell); }
+
+	template <typename Visit>
+	static void forEachNeighbour(const Board& board, int cell, Visit visit) {
+		const Topology* topology = board.topology();
+		const int* next = topology->neighbours(cell);
+		int count = topology->degree(cell);
+		for (int i = 0; i < count; ++i)
+			visit(next[i]);
+	}
+};
+
+#endif
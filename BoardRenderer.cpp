@@ -0,0 +1,158 @@
+/*	BoardRenderer.cpp
+ *
+ *	Draws boards a frame at a time. See BoardRenderer.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <cstdio>
+#include <sstream>
+
+#include "BoardRenderer.h"
+#include "ChainReaction.h"
+
+/* Escape codes for clearing the screen (with the cursor moved to its top left
+ * corner), and for clearing the rest of a line */
+static const char CLEAR_SCREEN[] = "\033[H\033[2J";
+static const char CLEAR_LINE[] = "\033[K";
+
+/* Text drawn by a modifier, which is nothing if it isn't enabled */
+static std::string modifierText(const Color::Modifier& modifier) {
+	std::ostringstream text;
+	text << modifier;
+	return text.str();
+}
+
+/* Appends the escape code moving the cursor to the given line and column of
+ * the screen, counted from one */
+static void appendCursor(int line, int column, std::string& text) {
+	char code[32];
+	int length = snprintf(code, sizeof(code), "\033[%d;%dH", line, column);
+	text.append(code, length);
+}
+
+BoardRenderer::BoardRenderer(std::ostream& out, bool ansi, int framesPerSecond) :
+							 out(out), ansi(ansi), frameInterval(0), lastGame(nullptr),
+							 rows(0), cols(0), lastMoves(0) {
+	if (framesPerSecond > 0)
+		frameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::seconds(1)) / framesPerSecond;
+}
+
+/* The board is drawn with its top edge on the first line of the screen, so
+ * the cell at (row, col) is drawn on line 2 + 2 * row, from column
+ * 2 + 4 * col, and the status on the line under the board's bottom edge */
+bool BoardRenderer::render(const ChainReaction& game, const std::string& status,
+						   bool force) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!force && lastGame != nullptr && now - lastFrame < frameInterval)
+		return false;
+	lastFrame = now;
+
+	frame.clear();
+	if (!ansi || lastGame == nullptr || game.rows != rows || game.cols != cols) {
+		if (ansi)
+			frame += CLEAR_SCREEN;
+		makePalette(game, palette);
+		format(game, frame);
+		frame += status;
+		if (ansi)
+			frame += CLEAR_LINE;
+		frame += '\n';
+		rows = game.rows;
+		cols = game.cols;
+		screen.resize(rows * cols);
+		for (int cell = 0; cell < rows * cols; ++cell)
+			screen[cell] = contents(game, cell);
+	} else {
+		if (&game != lastGame)
+			makePalette(game, palette);
+		if (&game == lastGame && game.numberOfMoves() == lastMoves + 1) {
+			for (int cell : game.changedCells())
+				repaint(game, cell);
+		} else {
+			for (int cell = 0; cell < rows * cols; ++cell)
+				repaint(game, cell);
+		}
+		appendCursor(2 * rows + 2, 1, frame);
+		frame += status;
+		frame += CLEAR_LINE;
+		frame += '\n';
+	}
+	lastGame = &game;
+	lastMoves = game.numberOfMoves();
+
+	out.write(frame.data(), frame.size());
+	out.flush();
+	return true;
+}
+
+void BoardRenderer::reset() {
+	lastGame = nullptr;
+}
+
+void BoardRenderer::format(const ChainReaction& game, std::string& text) {
+	Palette palette;
+	makePalette(game, palette);
+	text.reserve(text.size() + (game.rows * 2 + 1) * (game.cols * 4 + 2));
+	/* Top edge */
+	for (int j = 0; j < game.cols; ++j)
+		text += " ___";
+	text += '\n';
+
+	/* Rows */
+	for (int i = 0; i < game.rows; ++i) {
+		text += '|';
+		for (int j = 0; j < game.cols; ++j) {
+			appendCell(game, palette, game.index(i, j), text);
+			text += '|';
+		}
+		text += "\n|";
+		for (int j = 0; j < game.cols; ++j)
+			text += "___|";
+		text += '\n';
+	}
+}
+
+void BoardRenderer::makePalette(const ChainReaction& game, Palette& palette) {
+	palette.bold = modifierText(Color::Modifier(Color::BOLD, game.colorsEnabled));
+	palette.unbold = modifierText(Color::Modifier(Color::DEFAULT, game.colorsEnabled));
+	for (int id = NO_PLAYER + 1; id <= (int)game.players.size(); ++id) {
+		Player* player = game.playerFromId(id);
+		palette.color[id] = modifierText(player->color());
+		palette.uncolor[id] = modifierText(player->uncolor());
+	}
+}
+
+void BoardRenderer::appendCell(const ChainReaction& game, const Palette& palette,
+							   int cell, std::string& text) {
+	PlayerId owner = game.board.owner(cell);
+	if (owner == NO_PLAYER) {
+		text += "   ";
+		return;
+	}
+	int balls = game.board.balls(cell);
+	bool full = (balls == game.board.capacity(cell));
+	text += ' ';
+	if (full)
+		text += palette.bold;
+	text += palette.color[owner];
+	text += std::to_string(balls);
+	text += palette.uncolor[owner];
+	if (full)
+		text += palette.unbold;
+	text += ' ';
+}
+
+uint32_t BoardRenderer::contents(const ChainReaction& game, int cell) {
+	return (uint32_t)game.board.owner(cell) << 24 | game.board.balls(cell);
+}
+
+void BoardRenderer::repaint(const ChainReaction& game, int cell) {
+	uint32_t now = contents(game, cell);
+	if (screen[cell] == now)
+		return;
+	screen[cell] = now;
+	appendCursor(2 + 2 * (cell / cols), 2 + 4 * (cell % cols), frame);
+	appendCell(game, palette, cell, frame);
+}
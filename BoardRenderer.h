@@ -0,0 +1,107 @@
+/*	BoardRenderer.h
+ *
+ *	Draws the board of a game to a terminal, frame after frame, as a game is played.
+ *	Each frame is formatted into a single buffer, kept from one frame to the next, and
+ *	written out in one call, rather than streamed a cell at a time.
+ *
+ *	With ANSI escape codes, only the first frame draws the whole board: after that,
+ *	only the cells that changed since the last frame are repainted, moving the cursor
+ *	to each in turn. After a single move, these are found from the game's list of the
+ *	cells changed by the move (see ChainReaction::changedCells()), and otherwise by
+ *	comparing every cell with what was last drawn of it. Without escape codes, every
+ *	frame draws the whole board, as printing the game does.
+ *
+ *	The renderer may also be limited to a number of frames a second, for games between
+ *	computer players that play moves faster than they can be watched. Frames that come
+ *	too soon after the last are skipped.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _BOARDRENDERER_H_
+#define _BOARDRENDERER_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Board.h"
+
+class ChainReaction;
+
+class BoardRenderer {
+public:
+
+	/* Constructor takes the stream to draw to, whether to draw with ANSI
+	 * escape codes, and the most frames to draw in a second (zero for no
+	 * limit) */
+	BoardRenderer(std::ostream& out, bool ansi, int framesPerSecond = 0);
+
+	/* Draws the board of the given game, followed by the given line of status.
+	 * Returns false if the frame was skipped for coming too soon after the
+	 * last, which a forced frame never is. */
+	bool render(const ChainReaction& game, const std::string& status = "",
+				bool force = false);
+
+	/* Makes the next frame draw the whole board again (clearing the screen
+	 * first, with escape codes), as after anything else has been printed */
+	void reset();
+
+	/* Appends the board of the given game to the given text, as printing the
+	 * game shows it */
+	static void format(const ChainReaction& game, std::string& text);
+
+private:
+
+	std::ostream& out;
+	bool ansi;
+
+	/* Least time between frames, and when the last frame was drawn */
+	std::chrono::steady_clock::duration frameInterval;
+	std::chrono::steady_clock::time_point lastFrame;
+
+	/* Game last drawn, if any, its size, and the number of moves played in it
+	 * at the time */
+	const ChainReaction* lastGame;
+	int rows;
+	int cols;
+	int lastMoves;
+
+	/* Contents of each cell as last drawn, as its owner in the high byte and
+	 * its number of balls below */
+	std::vector<uint32_t> screen;
+
+	/* Text of the frame being drawn */
+	std::string frame;
+
+	/* Escape codes drawing a cell at capacity in bold, and each player's cells
+	 * in their color, by PlayerId (all empty if colors aren't enabled) */
+	struct Palette {
+		std::string bold;
+		std::string unbold;
+		std::array<std::string, MAX_PLAYERS + 1> color;
+		std::array<std::string, MAX_PLAYERS + 1> uncolor;
+	};
+	Palette palette;
+
+	/* Sets the palette for drawing the given game */
+	static void makePalette(const ChainReaction& game, Palette& palette);
+
+	/* Appends the three characters drawn inside the given cell, along with
+	 * the escape codes coloring them */
+	static void appendCell(const ChainReaction& game, const Palette& palette,
+						   int cell, std::string& text);
+
+	/* Returns the contents of a cell, as kept in screen */
+	static uint32_t contents(const ChainReaction& game, int cell);
+
+	/* Appends the repainting of the given cell, if it changed since it was
+	 * last drawn */
+	void repaint(const ChainReaction& game, int cell);
+
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*	BookBuilder.cpp
+ *
+ *	Builds opening books by searching every position of their first plies. See
+ *	BookBuilder.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "BookBuilder.h"
+#include "ChainReaction.h"
+
+/* Creates the AI players for the seats of a game */
+static std::vector<Player*> createSeats(const BookConfig& config) {
+	std::vector<Player*> seats;
+	for (int i = 0; i < config.players; ++i) {
+		AIPlayer* player = new AIPlayer("Book " + std::to_string(i + 1));
+		player->setHashSize(config.hashMegabytes);
+		player->setBudget(config.budget);
+		seats.push_back(player);
+	}
+	return seats;
+}
+
+/* Positions are kept as the moves (cell indices) leading to them, so that
+ * each worker can play them out on a game of its own. Each ply is searched
+ * in full before the next, whose positions are the children of the ply's,
+ * less those already found by another order of moves. */
+std::vector<OpeningBook::Entry> buildBook(const BookConfig& config, std::ostream* progress) {
+	std::vector<OpeningBook::Entry> entries;
+	std::vector<std::vector<int> > positions(1);
+	std::mutex resultLock;
+
+	for (int ply = 0; ply < config.plies && !positions.empty(); ++ply) {
+		bool expand = (ply + 1 < config.plies);
+		std::vector<std::vector<int> > children;
+		std::unordered_set<uint64_t> seen;
+		std::atomic<std::size_t> nextPosition(0);
+
+		auto work = [&]() {
+			std::vector<Player*> seats = createSeats(config);
+			while (true) {
+				std::size_t i = nextPosition++;
+				if (i >= positions.size())
+					break;
+				ChainReaction game(config.rows, config.cols, seats);
+				for (int cell : positions[i]) {
+					game.playerMove(cell / config.cols, cell % config.cols, game.currentPlayer());
+				}
+				if (game.gameOver())
+					continue;
+				uint64_t hash = game.hash();
+				AIPlayer* player = static_cast<AIPlayer*>(game.currentPlayer());
+				Position move = player->alphaBeta(game);
+				if (move.row < 0)
+					continue;
+
+				std::vector<std::pair<uint64_t, int> > moves;
+				if (expand) {
+					game.forEachValidMove(game.currentPlayer(), [&](int row, int col) {
+						game.makeMove(row, col);
+						moves.push_back(std::make_pair(game.hash(), row * config.cols + col));
+						game.unmakeMove();
+						return true;
+					});
+				}
+
+				OpeningBook::Entry entry;
+				entry.hash = hash;
+				entry.score = player->lastSearch().score;
+				entry.move = move.row * config.cols + move.col;
+				entry.depth = player->lastSearch().depth;
+				std::lock_guard<std::mutex> lock(resultLock);
+				entries.push_back(entry);
+				for (const std::pair<uint64_t, int>& child : moves) {
+					if (!seen.insert(child.first).second)
+						continue;
+					children.push_back(positions[i]);
+					children.back().push_back(child.second);
+				}
+			}
+			for (Player* seat : seats) {
+				delete seat;
+			}
+		};
+
+		int workers = (config.workers < 1) ? 1 : config.workers;
+		std::vector<std::thread> threads;
+		for (int i = 1; i < workers; ++i) {
+			threads.emplace_back(work);
+		}
+		work();
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		if (progress != nullptr) {
+			*progress << "Ply " << ply << ": searched " << positions.size()
+					  << " positions, " << entries.size() << " in the book" << std::endl;
+		}
+		positions.swap(children);
+	}
+	return entries;
+}
@@ -0,0 +1,48 @@
+/*	BookBuilder.h
+ *
+ *	This builds opening books (see OpeningBook.h) from deep searches made offline.
+ *	Starting from the empty board, every position reachable in fewer than a given
+ *	number of moves is searched by the alpha-beta AI with a generous budget, and the
+ *	move it chooses is stored in the book. The positions of each ply are found by
+ *	playing every valid move from those of the ply before, and positions reached by
+ *	more than one order of moves are only searched once.
+ *
+ *	Searches are shared out between worker threads, each with AI players of its own,
+ *	which take the next position to search from a shared counter, as the games of a
+ *	tournament are (see Tournament.h).
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _BOOKBUILDER_H_
+#define _BOOKBUILDER_H_
+
+#include <iostream>
+#include <vector>
+
+#include "AIPlayer.h"
+#include "OpeningBook.h"
+
+/* Settings of a book: the board and number of players it is for, the number of
+ * plies it covers, the budget and transposition table size of each search,
+ * and the number of worker threads */
+struct BookConfig {
+	BookConfig() : rows(5), cols(5), players(2), plies(2),
+				   budget(MOVE_MILLISECONDS * 10), hashMegabytes(HASH_MEGABYTES),
+				   workers(1) {}
+
+	int rows;
+	int cols;
+	int players;
+	int plies;
+	SearchBudget budget;
+	int hashMegabytes;
+	int workers;
+};
+
+/* Searches the positions of the book, and returns their entries. Reports
+ * progress after each ply to the given stream, if one is given. */
+std::vector<OpeningBook::Entry> buildBook(const BookConfig& config,
+										  std::ostream* progress = nullptr);
+
+#endif
@@ -5,103 +5,185 @@
  *	Vasco Portilheiro, 2015
  */
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "BoardRenderer.h"
 #include "ChainReaction.h"
-#include "Node.h"
 
-/* Constructor will initialize the board, which is represented by a graph
- * of Nodes containing the revelant information about the balls placed.
- * This graph is accessible through a two-dimensional array of pointers
- * to those nodes. The constructor will also create a local list of the
- * players, which it will update to reflect the players still in the game. */
+/* Constructor will initialize the board, which is stored as flat arrays
+ * containing the revelant information about the balls placed. The
+ * constructor will also create a local list of the players, which it will
+ * update to reflect the players still in the game. */
 ChainReaction::ChainReaction(int rows, int cols, 
 							 const std::vector<Player*>& playerList, bool colors) :
 							 rows(rows), cols(cols), colorsEnabled(colors),
-							 currentPlayerIdx(0),
-							 playerData(initPlayerData(playerList)) {
-
-	/* Create grid of empty Nodes */
-	nodeGrid = new Node*[rows * cols];
-	for (int row = 0; row < rows; ++row) {
-		for (int col = 0; col < cols; ++col) {
-			nodeGrid[index(row, col)] = new Node();
-		}
-	}
-	/* Initialize adjacency lists for each Node */
-	for (int row = 0; row < rows; ++row) {
-		for (int col = 0; col < cols; ++col) {
-			Node* currentNode = nodeGrid[index(row, col)];
-			for (int shift = -1; shift <= 1; shift += 2) {
-				if (isInBounds(row + shift, col)) {
-					currentNode->nextList.push_back(nodeGrid[index(row + shift, col)]);
-				}
-				if (isInBounds(row, col + shift)) {
-					currentNode->nextList.push_back(nodeGrid[index(row, col + shift)]);
-				}
-			}
-		}
+							 board(rows, cols), players(playerList),
+							 winner(nullptr),
+							 aliveMask((1u << playerList.size()) - 1), movedMask(0),
+							 maskWords((rows * cols + 63) / 64),
+							 ownedCells((playerList.size() + 1) * maskWords, 0),
+							 evalTerms((playerList.size() + 1) * NUM_EVAL_TERMS, 0),
+							 current(playerList.empty() ? NO_PLAYER : 1),
+							 cascadeQueued(rows * cols, 0),
+							 waveBoardEnabled(true),
+							 totalBalls(0),
+							 zobrist(std::make_shared<ZobristKeys>(rows * cols,
+																   playerList.size())),
+							 boardKey(0),
+							 recording(false), moveStamp(0),
+							 cellStamp(rows * cols, 0),
+							 moveKernel(moveKernelFor(rows, cols)) {
+	cascadeWave.reserve(board.size());
+	cascadeNextWave.reserve(board.size());
+	ballCounts.fill(0);
+	/* Every cell starts out empty */
+	for (int cell = 0; cell < board.size(); ++cell) {
+		ownedCells[cell / 64] |= uint64_t(1) << (cell % 64);
 	}
 }
 
-/* Copy constructor */
-ChainReaction::ChainReaction(ChainReaction& game) : rows(game.rows), cols(game.cols),
-													colorsEnabled(game.colorsEnabled),
-													currentPlayerIdx(game.currentPlayerIdx),
-													playerData(game.playerData) {
-	nodeGrid = new Node*[rows * cols];
-	for (int row = 0; row < rows; ++row) {
-		for (int col = 0; col < cols; ++col) {
-			nodeGrid[index(row, col)] = game.nodeGrid[game.index(row, col)];
-		}
+/* A game on a plain grid is no different from one made from its dimensions.
+ * Otherwise, the board of the plain grid is swapped for one made from the
+ * topology, before any ball is placed. */
+ChainReaction::ChainReaction(std::shared_ptr<const Topology> shape,
+							 const std::vector<Player*>& playerList, bool colors) :
+							 ChainReaction(shape->rows(), shape->cols(), playerList, colors) {
+	if (!shape->isPlainGrid()) {
+		topology = shape;
+		board = Board(*topology);
+		moveKernel = moveKernelFor(*topology);
 	}
 }
 
-/* Destructor will deallocation memory associated with the board */
-ChainReaction::~ChainReaction() {
-	/* Delete nodes */
-	for (int row = 0; row < rows; ++row) {
-		for (int col = 0; col < cols; ++col) {
-			delete nodeGrid[index(row, col)];
-		}
-	}
-	delete nodeGrid;
+/* Copy constructor. Since the board is a set of flat arrays, this copies
+ * the whole board at once. */
+ChainReaction::ChainReaction(const ChainReaction& game) :
+							 rows(game.rows), cols(game.cols),
+							 colorsEnabled(game.colorsEnabled),
+							 board(game.board), topology(game.topology),
+							 players(game.players),
+							 winner(game.winner),
+							 ballCounts(game.ballCounts),
+							 aliveMask(game.aliveMask), movedMask(game.movedMask),
+							 maskWords(game.maskWords),
+							 ownedCells(game.ownedCells),
+							 evalTerms(game.evalTerms),
+							 current(game.current),
+							 cascadeQueued(rows * cols, 0),
+							 waveBoardEnabled(game.waveBoardEnabled),
+							 cascade(game.cascade),
+							 totalBalls(game.totalBalls),
+							 zobrist(game.zobrist), boardKey(game.boardKey),
+							 recording(false), moveStamp(0),
+							 cellStamp(rows * cols, 0),
+							 moveKernel(game.moveKernel) {
+	cascadeWave.reserve(board.size());
+	cascadeNextWave.reserve(board.size());
 }
 
-/* Gets pointer to current player by using the index of the player
- * in the player data map */
+/* Gets pointer to current player from their id */
 Player* ChainReaction::currentPlayer() {
-	auto playerIt = playerData.begin();
-	std::advance(playerIt, currentPlayerIdx);
-	return playerIt->first;
+	return playerFromId(current);
 }
 
 /* Returns whether the game is over, by checking how many players are left */
 bool ChainReaction::gameOver() const {
-	return (playerData.size() == 1);
+	return (numberOfPlayers() == 1);
 }
 
 /* Returns number of player currently in game */
 int ChainReaction::numberOfPlayers() const {
-	return playerData.size();
+	return __builtin_popcount(aliveMask);
 }
 
 /* Will attempt to place a ball at the given position. Returns false if the
  * move is invalid. Otherwise, will place the ball and calculate and chain
- * reactions coming from the move, and finally return true. */
+ * reactions coming from the move, and finally return true. The cells the
+ * move changes are recorded as makeMove() records them, and then taken off
+ * the journal into the list of changed cells. */
 bool ChainReaction::playerMove(int row, int col, Player* player) {
 	if (isValidMove(row, col, player)) {
-		PlayerData& data = playerData[player];
-		if (data.firstMove) {
-			data.firstMove = false;
+		size_t start = cellJournal.size();
+		if (++moveStamp == 0) {
+			std::fill(cellStamp.begin(), cellStamp.end(), 0);
+			moveStamp = 1;
 		}
-		++(data.numberOfBalls);
-		Node* node = nodeGrid[index(row, col)];
-		addBallToNode(node, player);
-		updatePlayers();
+		recording = true;
+		applyMove(index(row, col), playerId(player));
+		recording = false;
+		changed.clear();
+		for (size_t i = start; i < cellJournal.size(); ++i)
+			changed.push_back(cellJournal[i].cell);
+		cellJournal.resize(start);
 		return true;
 	}
 	return false;
 }
 
+/* Plays the current player's move, first saving the state of the game
+ * outside the board in the journal. The board's cells are recorded as
+ * the move changes them. */
+bool ChainReaction::makeMove(int row, int col) {
+	if (!isInBounds(row, col))
+		return false;
+	PlayerId owner = board.owner(index(row, col));
+	if (owner != NO_PLAYER && owner != current)
+		return false;
+
+	MoveRecord record;
+	record.cellStart = cellJournal.size();
+	record.evalStart = evalJournal.size();
+	record.ballCounts = ballCounts;
+	record.aliveMask = aliveMask;
+	record.movedMask = movedMask;
+	record.current = current;
+	record.winner = winner;
+	record.totalBalls = totalBalls;
+	record.boardKey = boardKey;
+	record.cascade = cascade;
+	moveJournal.push_back(record);
+	evalJournal.insert(evalJournal.end(), evalTerms.begin(), evalTerms.end());
+
+	/* Stamps restart from one should they ever wrap around */
+	if (++moveStamp == 0) {
+		std::fill(cellStamp.begin(), cellStamp.end(), 0);
+		moveStamp = 1;
+	}
+	recording = true;
+	applyMove(index(row, col), current);
+	recording = false;
+	return true;
+}
+
+/* Restores the cells recorded for the last move, in reverse order, and
+ * then the players' data and the rest of the game state. The hash of the
+ * board and the evaluation terms are restored as a whole, rather than cell
+ * by cell. */
+void ChainReaction::unmakeMove() {
+	const MoveRecord& record = moveJournal.back();
+	while (cellJournal.size() > record.cellStart) {
+		const CellRecord& cellRecord = cellJournal.back();
+		changeOwner(cellRecord.cell, board.owner(cellRecord.cell), cellRecord.owner);
+		board.balls(cellRecord.cell) = cellRecord.balls;
+		board.owner(cellRecord.cell) = cellRecord.owner;
+		cellJournal.pop_back();
+	}
+	std::copy(evalJournal.begin() + record.evalStart, evalJournal.end(),
+			  evalTerms.begin());
+	evalJournal.resize(record.evalStart);
+	ballCounts = record.ballCounts;
+	aliveMask = record.aliveMask;
+	movedMask = record.movedMask;
+	current = record.current;
+	winner = record.winner;
+	totalBalls = record.totalBalls;
+	boardKey = record.boardKey;
+	cascade = record.cascade;
+	moveJournal.pop_back();
+}
+
 /* Return number of rows */
 int ChainReaction::getRows() {
 	return rows;
@@ -117,132 +199,465 @@ Player* ChainReaction::getWinner() {
 	return winner;
 }
 
+const std::vector<int>& ChainReaction::changedCells() const {
+	return changed;
+}
+
+/* Every move places exactly one ball */
+int ChainReaction::numberOfMoves() const {
+	return totalBalls;
+}
+
+/* Return the explosion and wave counts of the last move */
+const ChainReaction::CascadeStats& ChainReaction::lastCascade() const {
+	return cascade;
+}
+
+/* Returns the player's ball count, or zero for a player no longer in the
+ * game */
+int ChainReaction::numberOfBalls(Player const* player) const {
+	PlayerId id = playerId(player);
+	return isAlive(id) ? ballCounts[id] : 0;
+}
+
+/* Looks up the term in the player's block of terms */
+int ChainReaction::evalTerm(Player const* player, EvalTerm term) const {
+	return evalTerms[playerId(player) * NUM_EVAL_TERMS + term];
+}
+
+/* Counts the bits of the player's mask and of the mask of empty cells */
+int ChainReaction::numberOfValidMoves(Player const* player) const {
+	const uint64_t* empty = &ownedCells[NO_PLAYER * maskWords];
+	const uint64_t* owned = &ownedCells[playerId(player) * maskWords];
+	int count = 0;
+	for (int word = 0; word < maskWords; ++word) {
+		count += __builtin_popcountll(empty[word] | owned[word]);
+	}
+	return count;
+}
+
+/* Combines the hash of the board with the key of the player to move */
+uint64_t ChainReaction::hash() {
+	return boardKey ^ zobrist->toMove(current);
+}
+
+/* A single thread counts the whole tree in place. Otherwise the tree is
+ * counted one root move at a time. */
+uint64_t ChainReaction::perft(int depth, int threads) {
+	if (threads <= 1 || depth <= 1)
+		return perftNodes(depth);
+	uint64_t nodes = 0;
+	for (const PerftEntry& entry : perftDivide(depth, threads)) {
+		nodes += entry.nodes;
+	}
+	return nodes;
+}
+
+/* Threads take the next root move to count from a shared index, so that
+ * moves with larger subtrees don't hold up the others */
+std::vector<ChainReaction::PerftEntry> ChainReaction::perftDivide(int depth, int threads) {
+	std::vector<PerftEntry> entries;
+	if (depth < 1 || gameOver())
+		return entries;
+	forEachValidMove(currentPlayer(), [&](int row, int col) {
+		PerftEntry entry = { row, col, 0 };
+		entries.push_back(entry);
+		return true;
+	});
+
+	std::atomic<size_t> nextEntry(0);
+	auto work = [&](ChainReaction& game) {
+		for (size_t i = nextEntry++; i < entries.size(); i = nextEntry++) {
+			game.makeMove(entries[i].row, entries[i].col);
+			entries[i].nodes = game.perftNodes(depth - 1);
+			game.unmakeMove();
+		}
+	};
+	std::vector<ChainReaction> games;
+	games.reserve(threads > 1 ? threads - 1 : 0);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; ++i) {
+		games.emplace_back(*this);
+		ChainReaction* game = &games.back();
+		workers.emplace_back([&work, game]() { work(*game); });
+	}
+	work(*this);
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	return entries;
+}
+
+/* Sets whether to use waveBoard */
+void ChainReaction::useWaveBoard(bool use) {
+	waveBoardEnabled = use;
+}
+
 /* ===== Private Functions =====*/
 
-/* Adds a ball of the given player to the node, and calculates any
- * ensuing chain reactions */
-void ChainReaction::addBallToNode(Node* node, Player* player) {
-	if (node->player == nullptr)
-		node->player = player;
-	if (node->numberOfBalls + 1 == node->capacity()) {
-		explode(node);
+/* Places the ball, calculates the chain reaction, and updates the players.
+ * A chain reaction that could never end hands the game to the player. */
+void ChainReaction::applyMove(int cell, PlayerId player) {
+	(this->*moveKernel)(cell, player);
+}
+
+template <typename Layout>
+void ChainReaction::playMove(int cell, PlayerId player) {
+	uint8_t bit = 1u << (player - 1);
+	if (!(movedMask & bit)) {
+		movedMask |= bit;
+		boardKey ^= zobrist->hasMoved(player);
+	}
+	++ballCounts[player];
+	++totalBalls;
+	cascade = CascadeStats();
+	{
+		STAT_TIMER(timer, cascadeTicks);
+		if (addBallToNode<Layout>(cell, player))
+			resolveCascade<Layout>(cell);
+	}
+	STAT_CASCADE(cascade.explosions, cascade.waves);
+	if (cascade.saturated) {
+		declareWinner(player);
 	} else {
-		++(node->numberOfBalls);
+		updatePlayers(player);
+	}
+}
+
+/* Sizes of board given a FixedLayout: the default and most common sizes
+ * (including those opening books and endgame tables are made for), and the
+ * 9x6 board of the original game */
+ChainReaction::MoveKernel ChainReaction::moveKernelFor(int rows, int cols) {
+	static const struct {
+		int rows;
+		int cols;
+		MoveKernel kernel;
+	} kernels[] = {
+		{ 3, 3, &ChainReaction::playMove<FixedLayout<3, 3> > },
+		{ 4, 4, &ChainReaction::playMove<FixedLayout<4, 4> > },
+		{ 5, 5, &ChainReaction::playMove<FixedLayout<5, 5> > },
+		{ 6, 6, &ChainReaction::playMove<FixedLayout<6, 6> > },
+		{ 8, 8, &ChainReaction::playMove<FixedLayout<8, 8> > },
+		{ 9, 6, &ChainReaction::playMove<FixedLayout<9, 6> > },
+		{ 12, 12, &ChainReaction::playMove<FixedLayout<12, 12> > },
+	};
+	for (const auto& entry : kernels) {
+		if (entry.rows == rows && entry.cols == cols)
+			return entry.kernel;
 	}
+	return &ChainReaction::playMove<DynamicLayout>;
+}
+
+ChainReaction::MoveKernel ChainReaction::moveKernelFor(const Topology& topology) {
+	if (topology.rule() == FIXED_CAPACITY)
+		return &ChainReaction::playMove<CsrLayout<FixedCapacityRule> >;
+	return &ChainReaction::playMove<CsrLayout<NeighbourCapacityRule> >;
+}
+
+/* Adds the cell's current contents to the journal, once per recorded move */
+void ChainReaction::recordCell(int cell) {
+	if (recording && cellStamp[cell] != moveStamp) {
+		cellStamp[cell] = moveStamp;
+		CellRecord record = { cell, board.balls(cell), board.owner(cell) };
+		cellJournal.push_back(record);
+	}
+}
+
+/* Swaps the key of the cell's old contents for that of its new ones */
+template <typename Layout>
+void ChainReaction::setCell(int cell, int balls, PlayerId owner) {
+	boardKey ^= zobrist->cell(cell, board.owner(cell), board.balls(cell));
+	changeOwner(cell, board.owner(cell), owner);
+	countEvalTerms<Layout>(cell, -1);
+	board.balls(cell) = balls;
+	board.owner(cell) = owner;
+	countEvalTerms<Layout>(cell, 1);
+	boardKey ^= zobrist->cell(cell, owner, balls);
+}
+
+/* Clears the cell's bit in the old owner's mask and sets it in the new one */
+void ChainReaction::changeOwner(int cell, PlayerId from, PlayerId to) {
+	if (from != to) {
+		uint64_t bit = uint64_t(1) << (cell % 64);
+		ownedCells[from * maskWords + cell / 64] &= ~bit;
+		ownedCells[to * maskWords + cell / 64] |= bit;
+	}
+}
+
+/* A cell's own terms only count towards its owner, if it has one. Its
+ * vulnerability, and that of its neighbours, count towards their owners. */
+template <typename Layout>
+void ChainReaction::countEvalTerms(int cell, int change) {
+	PlayerId owner = board.owner(cell);
+	if (owner != NO_PLAYER) {
+		int* terms = &evalTerms[owner * NUM_EVAL_TERMS];
+		if (isCritical(cell))
+			terms[CRITICAL_CELLS] += change;
+		if (board.capacity(cell) == 2)
+			terms[CORNER_CELLS] += change;
+		else if (board.capacity(cell) == 3)
+			terms[EDGE_CELLS] += change;
+		if (isVulnerable<Layout>(cell))
+			terms[VULNERABLE_CELLS] += change;
+	}
+	Layout::forEachNeighbour(board, cell, [&](int next) {
+		PlayerId nextOwner = board.owner(next);
+		if (nextOwner != NO_PLAYER && isVulnerable<Layout>(next))
+			evalTerms[nextOwner * NUM_EVAL_TERMS + VULNERABLE_CELLS] += change;
+	});
+}
+
+/* Critical cells are owned, and will explode with one more ball */
+bool ChainReaction::isCritical(int cell) const {
+	return (board.owner(cell) != NO_PLAYER && board.capacity(cell) != 0
+			&& board.balls(cell) + 1 >= board.capacity(cell));
+}
+
+/* Checks the neighbours of an owned cell for critical cells of others */
+template <typename Layout>
+bool ChainReaction::isVulnerable(int cell) const {
+	PlayerId owner = board.owner(cell);
+	bool vulnerable = false;
+	Layout::forEachNeighbour(board, cell, [&](int next) {
+		vulnerable = vulnerable || (board.owner(next) != owner && isCritical(next));
+	});
+	return vulnerable;
+}
+
+/* Adds a ball of the given player to the cell, first capturing the cell if
+ * it belongs to another player. Returns whether the cell is now at capacity. */
+template <typename Layout>
+bool ChainReaction::addBallToNode(int cell, PlayerId player) {
+	recordCell(cell);
+	PlayerId owner = board.owner(cell);
+	if (owner != NO_PLAYER && owner != player)
+		captureNode(cell, player);
+	setCell<Layout>(cell, board.balls(cell) + 1, player);
+	return board.atCapacity(cell);
 }
 
 /* Will changes players' ball counts to reflect the given player
- * capturing the given node. */
-void ChainReaction::captureNode(Node* node, Player* capturingPlayer) {
-	int changedBalls = node->numberOfBalls;
-	playerData[node->player].numberOfBalls -= changedBalls;
-	playerData[capturingPlayer].numberOfBalls += changedBalls;
-	node->player = capturingPlayer;
-}
-
-/* "Explodes" a given node when it has reached its capacity. The node is
- * emptied, and a ball of the given player added to each adjacent node.
- * If the adjacent nodes belong to other players, they are changed to the
- * new player, and the player's ball counts respectively updated. */
-void ChainReaction::explode(Node* node) {
-	Player* capturingPlayer = node->player;
-	node->numberOfBalls = 0;
-	node->player = nullptr;
-	for (Node* nextNode : node->nextList) {
-		if (nextNode->player != nullptr && nextNode->player != capturingPlayer) {
-			captureNode(nextNode, capturingPlayer);
+ * capturing the given cell. The cell itself is changed over to the player
+ * along with its new ball, by addBallToNode(). */
+void ChainReaction::captureNode(int cell, PlayerId capturingPlayer) {
+	int changedBalls = board.balls(cell);
+	ballCounts[board.owner(cell)] -= changedBalls;
+	ballCounts[capturingPlayer] += changedBalls;
+}
+
+/* "Explodes" a given cell when it has reached its capacity. A ball for each
+ * adjacent cell is taken from the cell (as many as its capacity, unless the
+ * board has a fixed capacity), and a ball of the cell's player added to each
+ * adjacent cell. If the adjacent cells belong to other players, they are
+ * changed to the new player, and the player's ball counts respectively
+ * updated. Any cell left at capacity, including this one (should it have
+ * received more balls in the same wave) will explode in the next wave. */
+template <typename Layout>
+void ChainReaction::explode(int cell) {
+	recordCell(cell);
+	PlayerId capturingPlayer = board.owner(cell);
+	int balls = board.balls(cell) - Layout::spill(board, cell);
+	setCell<Layout>(cell, balls, (balls == 0) ? NO_PLAYER : capturingPlayer);
+	++cascade.explosions;
+	Layout::forEachNeighbour(board, cell, [&](int next) {
+		if (addBallToNode<Layout>(next, capturingPlayer))
+			queueExplosion(next);
+	});
+	if (board.atCapacity(cell))
+		queueExplosion(cell);
+}
+
+/* Chain reactions on plain grids of at least WAVE_BOARD_CELLS cells are
+ * handed over to WaveBoard once they have gone on for WAVE_BOARD_WAVES waves.
+ * Past that point, a wave over the whole board costs less than exploding the
+ * cells of a wave one by one. */
+static const int WAVE_BOARD_CELLS = 256;
+static const int WAVE_BOARD_WAVES = 4;
+
+/* Maximum number of waves a chain reaction may take before it is assumed
+ * never to end. A chain reaction that ends crosses the board in far fewer
+ * waves than this; it is only a guard against ones that go on forever. */
+static int maxWaves(const Board& board) {
+	return 16 * board.size() + 256;
+}
+
+/* Explodes cells wave by wave, starting from the given one, until no cell
+ * is left at capacity. Within a wave, the order in which cells explode
+ * does not change the board at the end of the wave.
+ * Since the moving player's ball count is kept up to date as balls are
+ * captured, the chain reaction is stopped at the end of the first wave after
+ * which that player has every ball on the board (as long as every other
+ * player has had their first move, and so can be eliminated). A board so
+ * full that it can never settle is otherwise stopped straight away, as is
+ * a chain reaction that goes on for more than maxWaves(). Long chain reactions
+ * on large boards are finished off by resolveWaves(). */
+template <typename Layout>
+void ChainReaction::resolveCascade(int cell) {
+	PlayerId mover = board.owner(cell);
+	const int& moverBalls = ballCounts[mover];
+	uint8_t others = aliveMask & ~(1u << (mover - 1));
+	bool canEliminate = ((others & ~movedMask) == 0);
+	bool settles = (totalBalls <= board.stableBalls());
+	int waveLimit = maxWaves(board);
+
+	cascadeWave.clear();
+	cascadeWave.push_back(cell);
+	cascadeQueued[cell] = 1;
+	while (!cascadeWave.empty()) {
+		if (canEliminate && moverBalls == totalBalls) {
+			cascade.eliminated = true;
+			break;
+		}
+		if ((!settles && !canEliminate) || cascade.waves == waveLimit) {
+			cascade.saturated = true;
+			break;
+		}
+		if (Layout::PLAIN_GRID && waveBoardEnabled && board.size() >= WAVE_BOARD_CELLS
+			&& cascade.waves >= WAVE_BOARD_WAVES) {
+			resolveWaves(mover, canEliminate, waveLimit);
+			break;
+		}
+		++cascade.waves;
+		cascadeNextWave.clear();
+		for (int waveCell : cascadeWave) {
+			cascadeQueued[waveCell] = 0;
+			explode<Layout>(waveCell);
 		}
-		addBallToNode(nextNode, capturingPlayer);
+		cascadeWave.swap(cascadeNextWave);
+	}
+	/* Clear flags of any cells left waiting when the chain reaction stopped */
+	for (int waveCell : cascadeWave) {
+		cascadeQueued[waveCell] = 0;
 	}
 }
 
-/* Returns the one-dimesional index in nodeGrid for given coordinates */
+/* The cells at capacity are those on the worklist, so waveBoard picks up
+ * where the worklist left off. Cells that changed hands are accounted for
+ * as they are copied back, as captureNode() does during explode(). */
+void ChainReaction::resolveWaves(PlayerId mover, bool canEliminate, int waveLimit) {
+	waveBoard.load(board);
+	WaveBoard::Result result = waveBoard.resolve(mover, canEliminate,
+												 waveLimit - cascade.waves);
+	cascade.explosions += result.explosions;
+	cascade.waves += result.waves;
+	cascade.eliminated = result.eliminated;
+	cascade.saturated = result.saturated;
+	for (int cell = 0; cell < board.size(); ++cell) {
+		int balls = waveBoard.balls(cell);
+		PlayerId owner = waveBoard.owner(cell);
+		if (balls != board.balls(cell) || owner != board.owner(cell)) {
+			recordCell(cell);
+			ballCounts[board.owner(cell)] -= board.balls(cell);
+			ballCounts[owner] += balls;
+			setCell<DynamicLayout>(cell, balls, owner);
+		}
+	}
+}
+
+/* Adds the cell to the next wave if it isn't already waiting to explode.
+ * (A cell waiting in the current wave will be checked again after it
+ * explodes.) */
+void ChainReaction::queueExplosion(int cell) {
+	if (!cascadeQueued[cell]) {
+		cascadeQueued[cell] = 1;
+		cascadeNextWave.push_back(cell);
+	}
+}
+
+/* Returns the one-dimesional index in the board for given coordinates */
 int ChainReaction::index(int row, int col) const {
-	return (row * cols) + col;
+	return board.index(row, col);
 }
 
-/* Initializes the map from players to their data given a list of players */
-ChainReaction::PlayerDataMapT
-ChainReaction::initPlayerData(const std::vector<Player*>& playerList) {
-	PlayerDataMapT playerData;
-	for (Player* player : playerList) {
-		playerData.emplace(player, PlayerData());
+/* Returns the position of the player in the list of players, counting
+ * from one */
+PlayerId ChainReaction::playerId(Player const* player) const {
+	for (size_t i = 0; i < players.size(); ++i) {
+		if (players[i] == player)
+			return i + 1;
 	}
-	return playerData;
-}	
+	return NO_PLAYER;
+}
+
+/* Returns the player in the list of players with the given id */
+Player* ChainReaction::playerFromId(PlayerId id) const {
+	if (id == NO_PLAYER)
+		return nullptr;
+	return players[id - 1];
+}
 
 /* Returns whether given coordinates are in bounds */
 bool ChainReaction::isInBounds(int row, int col) const {
-	return ((0 <= row && row < rows) && (0 <= col && col < cols));
+	return board.isInBounds(row, col);
 }
 
 /* Checks whether a player may place a ball at the given position.
- * Returns false if the coordinates are out of bounds, or if the position
- * already contains another players' balls. */
+ * Returns false if the player isn't one of the game's, if the coordinates
+ * are out of bounds, or if the position already contains another players'
+ * balls. */
 bool ChainReaction::isValidMove(int row, int col, Player const* player) const {
-	if (isInBounds(row, col)) {
-		Node* node = nodeGrid[index(row, col)];
-		return (node->player == nullptr || (node->player == player));
+	PlayerId id = playerId(player);
+	if (id != NO_PLAYER && isInBounds(row, col)) {
+		PlayerId owner = board.owner(index(row, col));
+		return (owner == NO_PLAYER || owner == id);
 	}
 	return false;
 }
 
-/* Removes any players with no balls on the board after the first move
- * from the playerData. Sets the winner if only one player left. */
-void ChainReaction::updatePlayers() {
-	for (std::map<Player*, PlayerData>::iterator it = playerData.begin();
-		 it != playerData.end();) {
-		Player* player = it->first;
-		PlayerData& data = it->second;
-		if (!data.firstMove && data.numberOfBalls == 0) {
-			playerData.erase(it++);
-		} else {
-			++it;
+/* Takes any players with no balls on the board after their first move out
+ * of the game, and passes the turn to the next player still in it after the
+ * mover, in order of their ids. Sets the winner if only one player left. */
+void ChainReaction::updatePlayers(PlayerId mover) {
+	int numPlayers = players.size();
+	for (int id = 1; id <= numPlayers; ++id) {
+		if (ballCounts[id] == 0)
+			aliveMask &= ~(movedMask & (1u << (id - 1)));
+	}
+	for (int i = 1; i <= numPlayers; ++i) {
+		PlayerId next = (mover - 1 + i) % numPlayers + 1;
+		if (isAlive(next)) {
+			current = next;
+			break;
 		}
 	}
-	currentPlayerIdx = (currentPlayerIdx + 1) % numberOfPlayers();
 	if (gameOver())
 		winner = currentPlayer();
 }
 
+/* Takes every other player out of the game, leaving the given player as
+ * the winner. */
+void ChainReaction::declareWinner(PlayerId player) {
+	aliveMask = 1u << (player - 1);
+	current = player;
+	winner = playerFromId(player);
+}
+
+/* Moves that end the game have no subtree, so they count as leaves only on
+ * the last level */
+uint64_t ChainReaction::perftNodes(int depth) {
+	if (depth == 0)
+		return 1;
+	if (gameOver())
+		return 0;
+	Player* player = currentPlayer();
+	if (depth == 1)
+		return numberOfValidMoves(player);
+	uint64_t nodes = 0;
+	forEachValidMove(player, [&](int row, int col) {
+		makeMove(row, col);
+		nodes += perftNodes(depth - 1);
+		unmakeMove();
+		return true;
+	});
+	return nodes;
+}
+
 
 /* ===== Operators ===== */
 
+/* The board is formatted into a single string, and written out at once */
 std::ostream& operator <<(std::ostream& out, const ChainReaction& game) {
-	Color::Modifier bold(Color::BOLD, game.colorsEnabled);
-	Color::Modifier unbold(Color::DEFAULT, game.colorsEnabled);
-	/* Top edge */
-	for (int i = 0; i < game.cols; ++i) {
-		out << " ___";
-	}
-	out << std::endl;
-
-	/* Rows */
-	for (int i = 0; i < game.rows; ++i) {
-		out << "|";
-		for (int j = 0; j < game.cols; ++j) {
-			Node* node = game.nodeGrid[game.index(i,j)];
-			if (node->player != nullptr) {
-				int balls = node->numberOfBalls;
-				out << " ";
-				if (balls == node->capacity()) {
-					out << bold;
-				}
-				out << node->player->color() << balls << node->player->uncolor();
-				if (balls == node->capacity()) {
-					out << unbold;
-				}
-				out << " |";
-			} else {
-				out << "   |";
-			}
-		}
-		out << std::endl;
-		out << "|";
-		for (int j = 0; j < game.cols; ++j) {
-			out << "___|";
-		}
-		out << std::endl;
-	}
-	return out;
+	std::string text;
+	BoardRenderer::format(game, text);
+	return out.write(text.data(), text.size());
 }
@@ -14,11 +14,16 @@
  *	a player may "capture" opponents' balls. A player loses when all their balls have
  *	been captured in this way. The last player alive is the winner.
  *
- *	To make the chain reaction calculations easier, the board is stored as a graph of
- *	nodes containing information on the balls at each location. However, since these
- *	nodes need to be accessible by row and column coordinateds, pointers to these
- *	nodes are stored in a two-dimensional array representing the board. (This array
- *	is also used to help initialize the graph with its connections.)
+ *	The board itself is stored as a flat Board (see Board.h): contiguous arrays of ball
+ *	counts, owner ids and capacities, indexed by row and column. Cells refer to their
+ *	owners by a small PlayerId, which is the player's position in the list of players
+ *	given to the game, counting from one. The players' own data is kept in arrays by
+ *	PlayerId too, with the players still in the game as a bitmask, and players take
+ *	turns in the order of their ids.
+ *
+ *	The game may also be played on a board of another shape -- a torus, a hex grid, or
+ *	a grid with diagonal neighbours -- or with every cell given the same capacity, by
+ *	making it from a Topology (see Topology.h).
  *
  *	Vasco Portilheiro, 2015
  */
@@ -26,37 +31,98 @@
 #ifndef _CHAINRXN_H_
 #define _CHAINRXN_H_
 
+#include <array>
 #include <iostream>
-#include <map>
+#include <memory>
 #include <vector>
 
+#include "Board.h"
 #include "colormod.h"
-#include "Node.h"
+#include "EngineStats.h"
 #include "Player.h"
+#include "WaveBoard.h"
+#include "Zobrist.h"
 
 static const bool BOLD_CAPACITY = true;
 
-/* AIPlayer class is given friend access to game,
- * in order to evaluate positions */
+/* AIPlayer and MCTSPlayer classes are given friend access to game,
+ * in order to evaluate positions, BatchGame in order to copy them,
+ * EndgameTable in order to index them, Snapshot in order to save
+ * and restore them, GameRecord and JournalReader in order to record
+ * and replay them, and BoardRenderer in order to draw them */
 class AIPlayer;
+class BatchGame;
+class BoardRenderer;
+class EndgameTable;
+class GameRecord;
+class JournalReader;
+class MCTSPlayer;
+class Snapshot;
 
 class ChainReaction {
 
 	friend class AIPlayer;
+	friend class MCTSPlayer;
+	friend class BatchGame;
+	friend class EndgameTable;
+	friend class Snapshot;
+	friend class GameRecord;
+	friend class JournalReader;
+	friend class BoardRenderer;
 
 public:
 
+	/* Summary of the chain reaction caused by a single move: the number of
+	 * explosions, and the number of waves they came in. A wave is the set of
+	 * cells that are at capacity at the same time, and which thus all explode
+	 * together. A move which causes no explosions has zero waves.
+	 * The flags record whether the chain reaction was cut short, either because
+	 * the moving player captured every ball on the board ("eliminated"), or
+	 * because it could never end ("saturated"). Either way the game is over. */
+	struct CascadeStats {
+		CascadeStats() : explosions(0), waves(0),
+						 eliminated(false), saturated(false) {}
+		int explosions;
+		int waves;
+		bool eliminated;
+		bool saturated;
+	};
+
+	/* Number of move sequences counted by perft() that start with the
+	 * given move */
+	struct PerftEntry {
+		int row;
+		int col;
+		uint64_t nodes;
+	};
+
+	/* Terms used to evaluate a position, counted for each player: cells one
+	 * ball short of capacity ("critical"), corner cells (capacity two) and
+	 * other edge cells (capacity three), and cells next to a critical cell of
+	 * another player ("vulnerable", since that player may capture them on
+	 * their next move). */
+	enum EvalTerm {
+		CRITICAL_CELLS,
+		CORNER_CELLS,
+		EDGE_CELLS,
+		VULNERABLE_CELLS,
+		NUM_EVAL_TERMS
+	};
+
 	/* Constructor initializes the board, and thus takes the number
-	 * of rows and columns. It also takes a list of players, which it will
-	 * copy locally. */
+	 * of rows and columns. It also takes a list of (at most MAX_PLAYERS)
+	 * players, which it will copy locally. The first player in the list
+	 * moves first. */
 	ChainReaction(int rows, int cols, const std::vector<Player*>& playerList,
 				  bool colorsEnabled = false);
 
-	//TODO: make deep copy constructor
-	ChainReaction(ChainReaction& game);
+	/* Constructor for a board of the given topology (see Topology.h), which
+	 * may be of another shape than the plain grid, or under other rules */
+	ChainReaction(std::shared_ptr<const Topology> topology,
+				  const std::vector<Player*>& playerList, bool colorsEnabled = false);
 
-	/* Deallocates memory associated with the board */
-	~ChainReaction();
+	/* Copy constructor, copies the board and the players' data */
+	ChainReaction(const ChainReaction& game);
 
 	/* Returns pointer to player whose turn it is */
 	Player* currentPlayer();
@@ -73,6 +139,17 @@ public:
 	 * ball at the position, do to there already being another player's balls there. */
 	bool playerMove(int row, int col, Player* player);
 
+	/* Plays a move for the current player, like playerMove(), but records
+	 * every change it makes to the board and the players' data, so that the
+	 * move can later be taken back by unmakeMove(). Moves may be nested, and
+	 * are taken back in the reverse order they were made. This is meant for
+	 * searching through moves on a single game, without copying it. */
+	bool makeMove(int row, int col);
+
+	/* Takes back the last move made by makeMove(), restoring the game to
+	 * exactly the state it was in before the move */
+	void unmakeMove();
+
 	/* Return number of rows in board */
 	int getRows();
 
@@ -82,13 +159,59 @@ public:
 	/* Return current state of "winner" variable */
 	Player* getWinner();
 
+	/* Returns the summary of the chain reaction caused by the last move */
+	const CascadeStats& lastCascade() const;
+
+	/* Returns the cells changed by the last move played with playerMove(),
+	 * each listed once, for redrawing only those cells of the board. Moves
+	 * made with makeMove() don't change the list. */
+	const std::vector<int>& changedCells() const;
+
+	/* Returns the number of moves played so far */
+	int numberOfMoves() const;
+
+	/* Calls visit(row, col) for each position the given player may place a
+	 * ball at, in order, until visit returns false. This takes time in
+	 * proportion to the number of such moves, rather than to the size of the
+	 * board. The game may be changed by visit, as long as it is restored before
+	 * visit returns (as with makeMove() followed by unmakeMove()). */
+	template <typename Visit>
+	void forEachValidMove(Player const* player, Visit visit) const;
+
+	/* Returns the number of positions the given player may place a ball at */
+	int numberOfValidMoves(Player const* player) const;
+
+	/* Returns the number of balls the given player has on the board */
+	int numberOfBalls(Player const* player) const;
+
+	/* Returns the given evaluation term of the given player. The terms are
+	 * kept up to date as cells change, so this takes constant time. */
+	int evalTerm(Player const* player, EvalTerm term) const;
+
+	/* Returns the Zobrist hash of the current position: the board, which
+	 * players have moved, and whose turn it is */
+	uint64_t hash();
+
+	/* Counts the sequences of valid moves of the given length from the current
+	 * position ("perft"), as a check of move generation, make/unmake and chain
+	 * reactions, and as a benchmark of them. A game that is over has no valid
+	 * moves, so sequences that end the game early are not counted. With more
+	 * than one thread, the moves of the current player are shared out between
+	 * the threads, each playing on its own copy of the game. */
+	uint64_t perft(int depth, int threads = 1);
+
+	/* Counts as perft() does, but separately for each valid move of the
+	 * current player ("divide"), in the order of forEachValidMove() */
+	std::vector<PerftEntry> perftDivide(int depth, int threads = 1);
+
+	/* Sets whether long chain reactions on large boards are handed over to
+	 * WaveBoard (as they are by default), or always resolved cell by cell */
+	void useWaveBoard(bool use);
+
 	friend std::ostream& operator <<(std::ostream& out,
 									 const ChainReaction& game);
 
 private:
-	
-	struct PlayerData;
-	using PlayerDataMapT = std::map<Player*, PlayerData>;
 
 	/* Number of rows and columns in the grid */
 	const int rows;
@@ -98,54 +221,212 @@ private:
 	 * color enabling overrides this. */
 	const bool colorsEnabled;
 
-	/* Array representing the board, which contains pointers to the corresponding
-	 * nodes at each location. */
-	Node** nodeGrid;
+	/* The board, holding the balls at each location, and the topology it was
+	 * made from (null for the plain grid) */
+	Board board;
+	std::shared_ptr<const Topology> topology;
+
+	/* List of all players given to the game, in order. A player's PlayerId is
+	 * their position in this list plus one. */
+	std::vector<Player*> players;
 
 	/* Stores the winner of a game. Null while the game is still being played,
 	 * or if the game ends in a tie (at the moment, it is uncertain whether this
 	 * is possible. */
 	Player* winner;
 
-	/* Structure to keep track of player specific data, such the number of balls
-	 * any player has on the board, and whether it's a player's first move */
-	struct PlayerData {
-		PlayerData(): numberOfBalls(0), firstMove(true) {}
-		int numberOfBalls;
-		int firstMove;
+	/* Number of balls each PlayerId has on the board (with NO_PLAYER's unused) */
+	std::array<int, MAX_PLAYERS + 1> ballCounts;
+
+	/* Masks of the players still in the game, and of those who have made
+	 * their first move, with bit (id - 1) for each PlayerId. A player who has
+	 * moved and has no balls left on the board is out of the game, which is
+	 * over when only one player is left. (The set of valid moves for each
+	 * player, used by the computer to search for optimal plays, is kept in
+	 * ownedCells.) */
+	uint8_t aliveMask;
+	uint8_t movedMask;
+
+	/* Bitmasks of the cells owned by each PlayerId, with those of empty cells
+	 * under NO_PLAYER, kept up to date as cells change hands. The cells a
+	 * player may place a ball in are their own and the empty ones. Each mask
+	 * is maskWords words long. */
+	int maskWords;
+	std::vector<uint64_t> ownedCells;
+
+	/* Evaluation terms of each PlayerId, NUM_EVAL_TERMS to a player */
+	std::vector<int> evalTerms;
+
+	/* PlayerId of the player whose turn it is */
+	PlayerId current;
+
+	/* Worklists for resolving chain reactions: the cells exploding in the
+	 * current wave, and those that have reached capacity and will explode in
+	 * the next. A cell is never on a list twice (see cascadeQueued), so each
+	 * holds at most one entry per cell of the board. */
+	std::vector<int> cascadeWave;
+	std::vector<int> cascadeNextWave;
+
+	/* Flags, by cell, for whether the cell is waiting on one of the worklists */
+	std::vector<uint8_t> cascadeQueued;
+
+	/* Lanes for resolving long chain reactions a wave at a time, and whether
+	 * to use them */
+	WaveBoard waveBoard;
+	bool waveBoardEnabled;
+
+	/* Summary of the chain reaction caused by the last move */
+	CascadeStats cascade;
+
+	/* Total number of balls on the board, which is also the number of moves
+	 * played so far */
+	int totalBalls;
+
+	/* Zobrist keys for this size of game, shared between copies of it */
+	std::shared_ptr<const ZobristKeys> zobrist;
+
+	/* Zobrist hash of the board and of which players have moved, kept up to
+	 * date as cells change (see setCell()) */
+	uint64_t boardKey;
+
+	/* Entry in the undo journal holding the contents of a cell before a move */
+	struct CellRecord {
+		int cell;
+		uint8_t balls;
+		PlayerId owner;
 	};
 
-	/* Dictionary from players to their data. For a regular, human vs human game
-	 * this data consists of the number of balls each player has on the board.
-	 * When this number reaches zero the player is removed from the dictionary.
-	 * Similarly, the game is over when only one player is left.
-	 * For games agains the computer, this will also contain a set of valid
-	 * moves for each player, in order to make searching for optimal plays
-	 * more efficient, not having to re-calculate the valid moves each time. */
-	PlayerDataMapT playerData;
-
-	/* Index of current player in the data map, used by currentPlayer() function
-	 * to find and return pointer to the actual player whose turn it is */
-	int currentPlayerIdx;
+	/* Entry in the undo journal for each move made by makeMove(). It holds the
+	 * game state outside the board from before the move, and where the move's
+	 * records start in the cell and evaluation journals. */
+	struct MoveRecord {
+		size_t cellStart;
+		size_t evalStart;
+		std::array<int, MAX_PLAYERS + 1> ballCounts;
+		uint8_t aliveMask;
+		uint8_t movedMask;
+		PlayerId current;
+		Player* winner;
+		int totalBalls;
+		uint64_t boardKey;
+		CascadeStats cascade;
+	};
 
-	/* Adds a ball of the given player to the node, and calculates any resulting
-	 * chain reactions */
-	void addBallToNode(Node* node, Player* player);
+	/* Undo journals for makeMove()/unmakeMove(). They are kept between moves,
+	 * so once they have grown to the size a search needs, making and
+	 * unmaking moves doesn't allocate memory. */
+	std::vector<CellRecord> cellJournal;
+	std::vector<int> evalJournal;
+	std::vector<MoveRecord> moveJournal;
+
+	/* Whether changes to cells are being recorded in the journal */
+	bool recording;
+
+	/* Cells changed by the last move played with playerMove() */
+	std::vector<int> changed;
+
+	/* Stamp of the move being recorded, and the stamp of the last move each
+	 * cell was recorded for, so that a cell changed many times in one chain
+	 * reaction is only recorded once per move */
+	uint32_t moveStamp;
+	std::vector<uint32_t> cellStamp;
+
+	/* Places a ball for the given player, who must be allowed to place it there,
+	 * and updates the game accordingly, with moveKernel */
+	void applyMove(int cell, PlayerId player);
+
+	/* Plays a move, as applyMove() does, on a board of the given layout (see
+	 * Board.h). The functions below that change cells are all specialized on
+	 * the layout, so that none of them has to work out the neighbours of a
+	 * cell for a board of any size. */
+	template <typename Layout>
+	void playMove(int cell, PlayerId player);
+
+	/* playMove() for the layout of the board, chosen by moveKernelFor() when
+	 * the game is created: a FixedLayout for the sizes of plain grid most often
+	 * played, DynamicLayout for other plain grids, and CsrLayout, under the
+	 * topology's rule, for boards made from a topology */
+	typedef void (ChainReaction::*MoveKernel)(int cell, PlayerId player);
+	MoveKernel moveKernel;
+	static MoveKernel moveKernelFor(int rows, int cols);
+	static MoveKernel moveKernelFor(const Topology& topology);
+
+	/* Records the contents of a cell in the journal, if moves are being
+	 * recorded and the cell hasn't been recorded yet for this move */
+	void recordCell(int cell);
+
+	/* Sets the contents of a cell, updating the hash of the board and the
+	 * masks of owned cells */
+	template <typename Layout>
+	void setCell(int cell, int balls, PlayerId owner);
+
+	/* Moves a cell from one owner's mask to another's */
+	void changeOwner(int cell, PlayerId from, PlayerId to);
+
+	/* Adds (for a change of one) or removes (for minus one) the evaluation
+	 * terms the cell adds to its owner, and the vulnerability of it and its
+	 * neighbours, which are all that changing the cell can affect */
+	template <typename Layout>
+	void countEvalTerms(int cell, int change);
+
+	/* Returns whether a cell is one ball short of capacity (or more) */
+	bool isCritical(int cell) const;
+
+	/* Returns whether a cell is next to a critical cell of another player */
+	template <typename Layout>
+	bool isVulnerable(int cell) const;
+
+	/* Adds a ball of the given player to the cell, capturing the cell if it
+	 * belongs to another player. Does not explode the cell, but returns whether
+	 * it has reached its capacity. */
+	template <typename Layout>
+	bool addBallToNode(int cell, PlayerId player);
 
 	/* Updates the player's ball counts when the given player captures the 
-	 * given node */
-	void captureNode(Node* node, Player* player);
+	 * given cell */
+	void captureNode(int cell, PlayerId player);
+
+	/* "Explodes" a cell when it has reached its capacity, queueing any
+	 * neighbours that reach their own capacity to explode in the next wave. */
+	template <typename Layout>
+	void explode(int cell);
 
-	/* "Explodes" a node when it has reached its capacity. */
-	void explode(Node* node);
+	/* Calculates the chain reaction started by the given cell reaching its
+	 * capacity. Cells are exploded in waves off of a worklist, rather than
+	 * recursively, so that long chains don't overflow the stack. */
+	template <typename Layout>
+	void resolveCascade(int cell);
+
+	/* Resolves the rest of a chain reaction with waveBoard, and copies the
+	 * cells it changed back to the board */
+	void resolveWaves(PlayerId mover, bool canEliminate, int waveLimit);
+
+	/* Puts a cell at capacity on the worklist for the next wave, unless it
+	 * is already waiting to explode */
+	void queueExplosion(int cell);
+
+	/* Ends the game with the given player as the only one left */
+	void declareWinner(PlayerId player);
+
+	/* Counts the leaves of the move tree of the given depth, with makeMove()
+	 * and unmakeMove(). The last level is counted without being played. */
+	uint64_t perftNodes(int depth);
 
 	/* Function that turns a row and a columns in to the corresponding index of the
-	 * nodeGrid array */
+	 * board */
 	int index(int row, int col) const;
 
-	/* Initialize the player data map using the given list of players.
-	 * This is (and should only by) called by the constructor. */
-	PlayerDataMapT initPlayerData(const std::vector<Player*>& playerList);
+	/* Returns the PlayerId of the given player, or NO_PLAYER if the player
+	 * is not part of this game */
+	PlayerId playerId(Player const* player) const;
+
+	/* Returns the player with the given id, or null for NO_PLAYER */
+	Player* playerFromId(PlayerId id) const;
+
+	/* Returns whether the player with the given id is still in the game */
+	bool isAlive(PlayerId id) const {
+		return (id != NO_PLAYER && (aliveMask >> (id - 1)) & 1);
+	}
 
 	/* Return whether a position in in bounds (on the board) */
 	bool isInBounds(int row, int col) const;
@@ -153,13 +434,34 @@ private:
 	/* Checks whether a player may place a ball at the given position */
 	bool isValidMove(int row, int col, Player const* player) const;
 
-	/* Updates the game's list of players. The list contains "active" players,
-	 * in other words, those who have not yet lost. If a player has no balls left
-	 * on the board, they are removed from the list. (Note that an exception is
-	 * made for the first move, and this each player has a flag for whether they
-	 * have played their first move yet.) */
-	void updatePlayers();
+	/* Updates the mask of players still in the game after a move by the given
+	 * player, and passes the turn on. If a player has no balls left on the
+	 * board, they are out of the game. (Note that an exception is made for the
+	 * first move, and thus each player has a bit in movedMask for whether
+	 * they have played their first move yet.) */
+	void updatePlayers(PlayerId mover);
 
 };
 
+/* Goes through the player's mask and the mask of empty cells a word at
+ * a time. Each word is read before any of its moves are visited, so that
+ * changes visit makes (and undoes) don't disturb the iteration. */
+template <typename Visit>
+void ChainReaction::forEachValidMove(Player const* player, Visit visit) const {
+	const uint64_t* empty = &ownedCells[NO_PLAYER * maskWords];
+	const uint64_t* owned = &ownedCells[playerId(player) * maskWords];
+	STAT_TIMER(timer, moveGenerationTicks);
+	for (int word = 0; word < maskWords; ++word) {
+		uint64_t moves = empty[word] | owned[word];
+		while (moves != 0) {
+			int cell = 64 * word + __builtin_ctzll(moves);
+			moves &= moves - 1;
+			STAT_PAUSE(timer);
+			if (!visit(cell / cols, cell % cols))
+				return;
+			STAT_RESUME(timer);
+		}
+	}
+}
+
 #endif
@@ -0,0 +1,203 @@
+/*	EndgameTable.cpp
+ *
+ *	Solves small boards, and maps and probes the tables of their outcomes. See
+ *	EndgameTable.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ChainReaction.h"
+#include "EndgameTable.h"
+
+/* Marks a file as an endgame table, and the version of its layout */
+static const char TABLE_MAGIC[8] = { 'C', 'R', 'E', 'N', 'D', 'G', '\0', '\0' };
+static const uint32_t TABLE_VERSION = 1;
+
+/* Number of players the table is for */
+static const int TABLE_PLAYERS = 2;
+
+const uint64_t EndgameTable::INVALID_INDEX;
+const uint8_t EndgameTable::WIN;
+const uint8_t EndgameTable::UNSOLVED;
+
+EndgameTable::EndgameTable() : mapping(nullptr), mappingSize(0), outcomes(nullptr),
+							   numEntries(0), numRows(0), numCols(0) {}
+
+EndgameTable::~EndgameTable() {
+	close();
+}
+
+/* Each cell holds up to one ball less than its capacity, of either player,
+ * or is empty. Indices are kept to 32 bits, which is plenty for any board
+ * small enough to solve. */
+uint64_t EndgameTable::index(const Board& board, PlayerId toMove) {
+	if (toMove < 1 || toMove > TABLE_PLAYERS)
+		return INVALID_INDEX;
+	uint64_t index = 0;
+	for (int cell = board.size() - 1; cell >= 0; --cell) {
+		int counts = std::max(1, (int)board.capacity(cell) - 1);
+		int states = 1 + TABLE_PLAYERS * counts;
+		int digit = 0;
+		if (board.balls(cell) != 0) {
+			PlayerId owner = board.owner(cell);
+			if (board.balls(cell) > counts || owner < 1 || owner > TABLE_PLAYERS)
+				return INVALID_INDEX;
+			digit = 1 + ((owner == toMove) ? 0 : counts) + (board.balls(cell) - 1);
+		}
+		index = index * states + digit;
+		if (index > UINT32_MAX)
+			return INVALID_INDEX;
+	}
+	return index;
+}
+
+/* The size of the array is checked against the size of the file before
+ * any of it is touched, as for opening books */
+bool EndgameTable::open(const std::string& path) {
+	close();
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || (std::size_t)status.st_size < sizeof(Header)) {
+		::close(file);
+		return false;
+	}
+	std::size_t length = status.st_size;
+	void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (data == MAP_FAILED)
+		return false;
+
+	const Header* header = static_cast<const Header*>(data);
+	if (memcmp(header->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0
+		|| header->version != TABLE_VERSION
+		|| (length - sizeof(Header)) != header->entries) {
+		munmap(data, length);
+		return false;
+	}
+	mapping = data;
+	mappingSize = length;
+	numEntries = header->entries;
+	outcomes = static_cast<const uint8_t*>(data) + sizeof(Header);
+	numRows = header->rows;
+	numCols = header->cols;
+	return true;
+}
+
+void EndgameTable::close() {
+	if (mapping != nullptr)
+		munmap(mapping, mappingSize);
+	mapping = nullptr;
+	mappingSize = 0;
+	outcomes = nullptr;
+	numEntries = 0;
+	numRows = numCols = 0;
+}
+
+bool EndgameTable::matches(int rows, int cols) const {
+	return numEntries > 0 && rows == numRows && cols == numCols;
+}
+
+bool EndgameTable::probe(const Board& board, PlayerId toMove, Result& result) const {
+	if (!matches(board.rows(), board.cols()))
+		return false;
+	uint64_t key = index(board, toMove);
+	if (key >= numEntries || outcomes[key] == UNSOLVED)
+		return false;
+	uint8_t outcome = outcomes[key];
+	result.win = (outcome & WIN) != 0;
+	result.distance = outcome & ~WIN;
+	return true;
+}
+
+/* Every position is solved by trying each move in turn, depth first from
+ * the empty board, remembering the outcome of each position solved so that
+ * a position reached again is not solved again. A move that ends the game
+ * wins it for the mover (or, in principle, loses it); any other move leads
+ * to a position that is won for the mover if it is lost for the opponent.
+ * The player to move picks the quickest win, or failing that the slowest
+ * loss. Since positions are seen from the player to move, the games of
+ * either player moving first are the same, and only one order of the
+ * players needs to be played. */
+bool EndgameTable::solve(int rows, int cols, const std::string& path, std::ostream* progress) {
+	Board board(rows, cols);
+	for (int cell = 0; cell < board.size(); ++cell) {
+		if (board.capacity(cell) > 0)
+			board.balls(cell) = board.capacity(cell) - 1;
+		board.owner(cell) = TABLE_PLAYERS;
+	}
+	uint64_t lastIndex = index(board, 1);
+	if (lastIndex == INVALID_INDEX)
+		return false;
+
+	std::vector<uint8_t> solved(lastIndex + 1, UNSOLVED);
+	std::size_t numSolved = 0;
+	std::function<uint8_t(ChainReaction&)> solvePosition = [&](ChainReaction& game) {
+		uint32_t key = index(game.board, game.playerId(game.currentPlayer()));
+		if (solved[key] != UNSOLVED)
+			return solved[key];
+		Player* mover = game.currentPlayer();
+		bool win = false;
+		int distance = 0;
+		game.forEachValidMove(mover, [&](int row, int col) {
+			game.makeMove(row, col);
+			bool moveWins;
+			int moveDistance = 1;
+			if (game.gameOver()) {
+				moveWins = (game.getWinner() == mover);
+			} else {
+				uint8_t outcome = solvePosition(game);
+				moveWins = (outcome & WIN) == 0;
+				moveDistance += outcome & ~WIN;
+			}
+			game.unmakeMove();
+			if (moveWins && (!win || moveDistance < distance)) {
+				win = true;
+				distance = moveDistance;
+			} else if (!moveWins && !win && moveDistance > distance) {
+				distance = moveDistance;
+			}
+			return true;
+		});
+		uint8_t outcome = (win ? WIN : 0) | distance;
+		solved[key] = outcome;
+		++numSolved;
+		return outcome;
+	};
+
+	Player one("Player 1");
+	Player two("Player 2");
+	ChainReaction game(rows, cols, std::vector<Player*>{ &one, &two });
+	solvePosition(game);
+	if (progress != nullptr) {
+		*progress << "Solved " << numSolved << " of " << solved.size()
+				  << " positions" << std::endl;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+	header.version = TABLE_VERSION;
+	header.rows = rows;
+	header.cols = cols;
+	header.entries = solved.size();
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(solved.data(), sizeof(uint8_t), solved.size(), file) == solved.size();
+	return fclose(file) == 0 && written;
+}
@@ -0,0 +1,119 @@
+/*	EndgameTable.h
+ *
+ *	A table of the solved outcome of every position of two-player games on a small
+ *	board (such as 2x2, 2x3, 3x3 or 3x4), for the AI to play perfectly on it without
+ *	searching. Every move adds a ball to the board, and the balls a board can hold
+ *	without exploding are limited, so a game can't go on for long, and no game is
+ *	drawn. The table thus holds, for the player to move, whether they win or lose,
+ *	and in how many plies the game ends when both players play perfectly (winning as
+ *	soon as possible, and losing as late as possible).
+ *
+ *	A position is indexed by a packed encoding of its cells, seen from the player to
+ *	move (so that a position and the one with the players' balls swapped share an
+ *	index, as they share an outcome): each cell is a digit, zero when empty and
+ *	otherwise counting through the ball counts of the player to move and then of
+ *	their opponent, in a number whose radix at each cell is the number of states that
+ *	cell can be in. Most indices are of positions reachable from the empty board, so
+ *	the table is simply an array of outcomes by index, with the positions that can't
+ *	be reached marked as such, and a position is looked up in a single read. As with
+ *	opening books, the file is mapped into memory.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _ENDGAMETABLE_H_
+#define _ENDGAMETABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "Board.h"
+
+class EndgameTable {
+public:
+
+	/* Outcome of a position for the player to move, and the number of plies
+	 * until the game ends */
+	struct Result {
+		bool win;
+		int distance;
+	};
+
+	/* Constructor creates an empty table, until one is opened */
+	EndgameTable();
+
+	/* Destructor unmaps the file */
+	~EndgameTable();
+
+	EndgameTable(const EndgameTable&) = delete;
+	EndgameTable& operator =(const EndgameTable&) = delete;
+
+	/* Maps the given table file into memory, closing any table already open.
+	 * Returns false if the file can't be mapped, or isn't a valid table. */
+	bool open(const std::string& path);
+
+	/* Unmaps the file, leaving the table empty */
+	void close();
+
+	/* Returns whether the table is for boards of the given size */
+	bool matches(int rows, int cols) const;
+
+	/* Looks up the position on the given board with the given player to move.
+	 * Returns true and fills in the result if it is in the table. */
+	bool probe(const Board& board, PlayerId toMove, Result& result) const;
+
+	/* Number of indices in the table, including those of positions that
+	 * can't be reached */
+	std::size_t size() const { return numEntries; }
+
+	/* Size of board the table is for */
+	int rows() const { return numRows; }
+	int cols() const { return numCols; }
+
+	/* Solves every position of two-player games on a board of the given size,
+	 * and writes the table to the given path. Reports progress to the given
+	 * stream, if one is given. Returns false if the board is too large to be
+	 * indexed, or the file couldn't be written. */
+	static bool solve(int rows, int cols, const std::string& path,
+					  std::ostream* progress = nullptr);
+
+private:
+
+	/* Header at the start of a table file */
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint16_t rows;
+		uint16_t cols;
+		uint64_t entries;
+	};
+
+	/* Index of a position, or INVALID_INDEX if the board is too large to be
+	 * indexed, or holds anything a settled two-player position can't. The
+	 * highest index is that of a board full of the opponent's balls. */
+	static const uint64_t INVALID_INDEX = ~uint64_t(0);
+	static uint64_t index(const Board& board, PlayerId toMove);
+
+	/* Outcome, packed into a byte: the distance, with the top bit set for a
+	 * win. No game on a board small enough to solve is long enough to reach
+	 * the distance of UNSOLVED, which marks positions not solved (because
+	 * they can't be reached). */
+	static const uint8_t WIN = 0x80;
+	static const uint8_t UNSOLVED = 0xff;
+
+	/* Mapping of the file, if one is open */
+	void* mapping;
+	std::size_t mappingSize;
+
+	/* Outcomes of the positions, by index */
+	const uint8_t* outcomes;
+	std::size_t numEntries;
+
+	int numRows;
+	int numCols;
+
+};
+
+#endif
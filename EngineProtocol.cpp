@@ -0,0 +1,431 @@
+/*	EngineProtocol.cpp
+ *
+ *	Reads and answers the commands of the engine protocol. See EngineProtocol.h for
+ *	the commands.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+
+#include "EngineProtocol.h"
+#include "Snapshot.h"
+#include "TranspositionTable.h"
+
+/* Number of players in a game started without saying */
+static const int DEFAULT_PLAYERS = 2;
+
+/* Largest transposition table a player may be given, in megabytes */
+static const int MAX_HASH_MEGABYTES = 1 << 16;
+
+/* Largest number of threads a search may be given */
+static const int MAX_THREADS = 256;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/* Writes the given bytes as two hexadecimal digits each */
+static std::string toHex(const std::vector<uint8_t>& data) {
+	std::string text(data.size() * 2, '0');
+	for (std::size_t i = 0; i < data.size(); ++i) {
+		text[2 * i] = HEX_DIGITS[data[i] >> 4];
+		text[2 * i + 1] = HEX_DIGITS[data[i] & 0xf];
+	}
+	return text;
+}
+
+static int hexDigit(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Reads bytes written as two hexadecimal digits each. Returns false if the
+ * text isn't made of such pairs. */
+static bool fromHex(const std::string& text, std::vector<uint8_t>& data) {
+	if (text.size() % 2 != 0)
+		return false;
+	data.resize(text.size() / 2);
+	for (std::size_t i = 0; i < data.size(); ++i) {
+		int high = hexDigit(text[2 * i]);
+		int low = hexDigit(text[2 * i + 1]);
+		if (high < 0 || low < 0)
+			return false;
+		data[i] = (high << 4) | low;
+	}
+	return true;
+}
+
+EngineProtocol::EngineProtocol(std::istream& in, std::ostream& out) :
+							   in(in), out(out), hashMegabytes(HASH_MEGABYTES), threads(1),
+							   searching(false), unlimited(false), stopSearch(false) {}
+
+EngineProtocol::~EngineProtocol() {
+	finishSearch(true);
+	for (Player* player : players)
+		delete player;
+}
+
+void EngineProtocol::run() {
+	std::string line;
+	while (std::getline(in, line)) {
+		if (!handle(line))
+			return;
+	}
+	finishSearch(true);
+}
+
+/* Blank lines are ignored, as are commands that aren't known, which are
+ * reported */
+bool EngineProtocol::handle(const std::string& line) {
+	std::istringstream args(line);
+	std::string command;
+	if (!(args >> command))
+		return true;
+
+	if (command == "quit") {
+		finishSearch(true);
+		return false;
+	}
+
+	if (command == "isready") {
+		respond("readyok");
+	} else if (command == "stop") {
+		finishSearch(true);
+	} else {
+		finishSearch(false);
+		if (command == "crx")
+			identify();
+		else if (command == "setoption")
+			setOption(args);
+		else if (command == "newgame")
+			newGame(args);
+		else if (command == "position")
+			setPosition(args);
+		else if (command == "move")
+			playMoves(args);
+		else if (command == "go")
+			go(args);
+		else if (command == "d")
+			display();
+		else if (command == "snapshot")
+			showSnapshot();
+		else
+			respond("info string error: unknown command " + command);
+	}
+	flush();
+	return true;
+}
+
+void EngineProtocol::identify() {
+	std::lock_guard<std::mutex> guard(outputLock);
+	out << "id name ChainReaction\n"
+		<< "id author Vasco Portilheiro\n"
+		<< "option name Hash type spin default " << HASH_MEGABYTES
+		<< " min 1 max " << MAX_HASH_MEGABYTES << "\n"
+		<< "option name Threads type spin default 1 min 1 max " << MAX_THREADS << "\n"
+		<< "option name Book type string\n"
+		<< "option name Endgame type string\n"
+		<< "crxok\n";
+}
+
+/* The option's value is the rest of the line, so that a path may have
+ * spaces in it. Each setting is passed on to the players straight away. */
+void EngineProtocol::setOption(std::istringstream& args) {
+	std::string word, name, value;
+	if (!(args >> word) || word != "name" || !(args >> name) || !(args >> word)
+		|| word != "value" || !(args >> std::ws) || !std::getline(args, value)) {
+		respond("info string error: expected setoption name N value V");
+		return;
+	}
+	if (name == "Hash" || name == "Threads") {
+		int number;
+		std::istringstream valueStream(value);
+		int limit = (name == "Hash") ? MAX_HASH_MEGABYTES : MAX_THREADS;
+		if (!(valueStream >> number) || number < 1 || number > limit) {
+			respond("info string error: invalid value for " + name + ": " + value);
+			return;
+		}
+		if (name == "Hash")
+			hashMegabytes = number;
+		else
+			threads = number;
+		for (Player* player : players) {
+			AIPlayer* ai = static_cast<AIPlayer*>(player);
+			if (name == "Hash")
+				ai->setHashSize(hashMegabytes);
+			else
+				ai->setThreads(threads);
+		}
+	} else if (name == "Book") {
+		std::shared_ptr<OpeningBook> book(new OpeningBook());
+		if (!book->open(value)) {
+			respond("info string error: could not open opening book " + value);
+			return;
+		}
+		books.push_back(book);
+		for (Player* player : players)
+			static_cast<AIPlayer*>(player)->addBook(book);
+	} else if (name == "Endgame") {
+		std::shared_ptr<EndgameTable> endgame(new EndgameTable());
+		if (!endgame->open(value)) {
+			respond("info string error: could not open endgame table " + value);
+			return;
+		}
+		endgames.push_back(endgame);
+		for (Player* player : players)
+			static_cast<AIPlayer*>(player)->addEndgameTable(endgame);
+	} else {
+		respond("info string error: unknown option " + name);
+	}
+}
+
+/* The players are kept from one game to the next if there are as many of
+ * them, along with what their transposition tables have learned */
+void EngineProtocol::newGame(std::istringstream& args) {
+	int rows, cols;
+	int numPlayers = DEFAULT_PLAYERS;
+	if (!(args >> rows >> cols) || rows < 1 || cols < 1
+		|| rows > 0xffff || cols > 0xffff / rows
+		|| ((args >> std::ws).good() && !(args >> numPlayers))
+		|| numPlayers < 1 || numPlayers > MAX_PLAYERS) {
+		respond("info string error: expected newgame R C [P], with at most "
+				+ std::to_string(MAX_PLAYERS) + " players");
+		return;
+	}
+	if ((int)players.size() != numPlayers) {
+		for (Player* player : players)
+			delete player;
+		players.clear();
+		for (int i = 0; i < numPlayers; ++i) {
+			AIPlayer* player = new AIPlayer("Seat " + std::to_string(i + 1));
+			configure(player);
+			players.push_back(player);
+		}
+	}
+	game.reset(new ChainReaction(rows, cols, players));
+	Snapshot::save(*game, start);
+	base = start;
+	history.clear();
+}
+
+/* If the position is the current one with more moves played, only the new
+ * moves are played, so that a client sending the whole game before each
+ * search doesn't have it replayed every time. Otherwise the game is restored
+ * to the base position in place, rather than built again. */
+void EngineProtocol::setPosition(std::istringstream& args) {
+	if (!hasGame())
+		return;
+	std::string kind;
+	std::vector<uint8_t> position;
+	args >> kind;
+	if (kind == "startpos") {
+		position = start;
+	} else if (kind == "snapshot") {
+		std::string text;
+		if (!(args >> text) || !fromHex(text, position)) {
+			respond("info string error: expected a snapshot in hexadecimal");
+			return;
+		}
+	} else {
+		respond("info string error: expected position startpos or position snapshot");
+		return;
+	}
+
+	std::string word;
+	std::vector<int> moves;
+	if (args >> word) {
+		if (word != "moves") {
+			respond("info string error: expected moves, not " + word);
+			return;
+		}
+		int row, col;
+		char comma;
+		while (args >> row >> comma >> col) {
+			if (comma != ',' || row < 0 || row >= game->getRows() || col < 0
+				|| col >= game->getCols()) {
+				respond("info string error: expected moves as row,column on the board");
+				return;
+			}
+			moves.push_back(row * game->getCols() + col);
+		}
+		if (!(args >> std::ws).eof()) {
+			respond("info string error: expected moves as row,column");
+			return;
+		}
+	}
+
+	std::size_t played = 0;
+	if (position == base && history.size() <= moves.size()
+		&& std::equal(history.begin(), history.end(), moves.begin())) {
+		played = history.size();
+	} else {
+		if (!Snapshot::restore(position.data(), position.size(), *game)) {
+			respond("info string error: snapshot is invalid or not of this game");
+			return;
+		}
+		base.swap(position);
+		history.clear();
+	}
+	int cols = game->getCols();
+	for (std::size_t i = played; i < moves.size(); ++i) {
+		int row = moves[i] / cols, col = moves[i] % cols;
+		if (moves[i] < 0 || game->gameOver()
+			|| !game->playerMove(row, col, game->currentPlayer())) {
+			respond("info string error: illegal move " + std::to_string(row) + ","
+					+ std::to_string(col));
+			return;
+		}
+		history.push_back(moves[i]);
+	}
+}
+
+void EngineProtocol::playMoves(std::istringstream& args) {
+	if (!hasGame())
+		return;
+	int row, col;
+	char comma;
+	while (args >> row >> comma >> col) {
+		if (comma != ',' || game->gameOver()
+			|| !game->playerMove(row, col, game->currentPlayer())) {
+			respond("info string error: illegal move " + std::to_string(row) + ","
+					+ std::to_string(col));
+			return;
+		}
+		history.push_back(row * game->getCols() + col);
+	}
+	if (!(args >> std::ws).eof())
+		respond("info string error: expected moves as row,column");
+}
+
+/* Without any limit given, the search has the default budget. "infinite"
+ * lifts the time limit, leaving the search to run until stopped. */
+void EngineProtocol::go(std::istringstream& args) {
+	if (!hasGame())
+		return;
+	SearchBudget budget;
+	bool limited = false;
+	bool infinite = false;
+	std::string word;
+	while (args >> word) {
+		long long value = 0;
+		if (word == "infinite") {
+			infinite = true;
+			continue;
+		}
+		if ((word != "movetime" && word != "nodes" && word != "depth")
+			|| !(args >> value) || value < 0) {
+			respond("info string error: expected go [movetime MS] [nodes N] "
+					"[depth D] [infinite]");
+			return;
+		}
+		if (!limited) {
+			budget = SearchBudget(0, 0, DEPTH);
+			limited = true;
+		}
+		if (word == "movetime")
+			budget.milliseconds = value;
+		else if (word == "nodes")
+			budget.nodes = value;
+		else
+			budget.depth = std::max(1LL, std::min<long long>(value, DEPTH));
+	}
+	if (infinite)
+		budget = SearchBudget(0, 0, DEPTH);
+	else if (limited && budget.milliseconds == 0 && budget.nodes == 0
+			 && budget.depth == DEPTH)
+		infinite = true;
+
+	if (game->gameOver()) {
+		respond("bestmove none");
+		return;
+	}
+	stopSearch = false;
+	budget.stop = &stopSearch;
+	unlimited = infinite;
+	searching = true;
+	searcher = std::thread(&EngineProtocol::search, this, budget);
+}
+
+void EngineProtocol::search(SearchBudget budget) {
+	AIPlayer* player = static_cast<AIPlayer*>(game->currentPlayer());
+	Position move = player->alphaBeta(*game, budget);
+	const SearchInfo& info = player->lastSearch();
+	double seconds = info.milliseconds / 1000;
+
+	std::lock_guard<std::mutex> guard(outputLock);
+	out << "info depth " << info.depth << " score " << info.score
+		<< " nodes " << info.nodes << " time " << (long long)info.milliseconds
+		<< " nps " << (long long)(seconds > 0 ? info.nodes / seconds : 0)
+		<< " hitrate " << player->transpositionTable().hitRate();
+	if (info.fromBook)
+		out << " book";
+	if (info.fromEndgame)
+		out << " endgame";
+	out << "\n";
+	if (move.row < 0)
+		out << "bestmove none\n";
+	else
+		out << "bestmove " << move.row << "," << move.col << "\n";
+	out.flush();
+}
+
+void EngineProtocol::finishSearch(bool stop) {
+	if (!searching)
+		return;
+	if (stop || unlimited)
+		stopSearch = true;
+	searcher.join();
+	searching = false;
+}
+
+void EngineProtocol::display() {
+	if (!hasGame())
+		return;
+	std::lock_guard<std::mutex> guard(outputLock);
+	out << *game;
+	if (game->gameOver())
+		out << "winner " << game->getWinner()->getName() << "\n";
+	else
+		out << "to move " << game->currentPlayer()->getName() << "\n";
+	out << "hash " << std::hex << game->hash() << std::dec << "\n";
+}
+
+void EngineProtocol::showSnapshot() {
+	if (!hasGame())
+		return;
+	std::vector<uint8_t> data;
+	if (!Snapshot::save(*game, data))
+		respond("info string error: position can't be packed into a snapshot");
+	else
+		respond("snapshot " + toHex(data));
+}
+
+void EngineProtocol::configure(AIPlayer* player) const {
+	player->setHashSize(hashMegabytes);
+	player->setThreads(threads);
+	for (const std::shared_ptr<const OpeningBook>& book : books)
+		player->addBook(book);
+	for (const std::shared_ptr<const EndgameTable>& endgame : endgames)
+		player->addEndgameTable(endgame);
+}
+
+void EngineProtocol::respond(const std::string& line) {
+	std::lock_guard<std::mutex> guard(outputLock);
+	out << line << "\n";
+}
+
+void EngineProtocol::flush() {
+	std::lock_guard<std::mutex> guard(outputLock);
+	out.flush();
+}
+
+bool EngineProtocol::hasGame() {
+	if (game)
+		return true;
+	respond("info string error: no game, start one with newgame");
+	return false;
+}
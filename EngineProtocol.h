@@ -0,0 +1,140 @@
+/*	EngineProtocol.h
+ *
+ *	A line-based protocol for driving the AI from another process, in the spirit of
+ *	UCI for chess engines. The engine reads one command a line from its input and
+ *	writes its responses to its output, and stays up between games, so its players
+ *	(and their transposition tables) are kept warm from one search to the next, and
+ *	a position that only gains moves is played forward rather than rebuilt.
+ *
+ *	Commands are:
+ *
+ *	crx							identifies the engine and lists its options, ending
+ *								with "crxok"
+ *	isready						answers "readyok"
+ *	setoption name N value V	sets option N: Hash (megabytes per player), Threads
+ *								(per search), Book or Endgame (a file to add)
+ *	newgame R C [P]				starts a game on an R by C board with P players
+ *								(default 2), seated in order from the first to move
+ *	position startpos [moves M...]
+ *	position snapshot HEX [moves M...]
+ *								sets the position to the start of the game, or to
+ *								a snapshot (see Snapshot.h) in hexadecimal, and then
+ *								plays the given moves
+ *	move M...					plays the given moves on the current position
+ *	go [movetime MS] [nodes N] [depth D] [infinite]
+ *								searches for the best move of the player to move,
+ *								in the background, within the given budget (or the
+ *								default one), and reports "info" and "bestmove"
+ *	stop						stops the search, which then reports its best move
+ *	snapshot					answers with a snapshot of the current position
+ *	d							shows the board, the player to move and the hash
+ *	quit						stops any search and exits
+ *
+ *	Moves are given as "row,column". Errors are reported as "info string" lines. While
+ *	a search is running, any command but "isready" and "stop" waits for it to finish
+ *	first (and stops it first if it has no limit, as with "go infinite").
+ *
+ *	Responses are written without flushing, and the output is flushed once the
+ *	responses to a command (or a search) are all written.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _ENGINEPROTOCOL_H_
+#define _ENGINEPROTOCOL_H_
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AIPlayer.h"
+#include "ChainReaction.h"
+#include "EndgameTable.h"
+#include "OpeningBook.h"
+
+class EngineProtocol {
+public:
+
+	/* Constructor takes the streams to read commands from and write responses
+	 * to. There is no game until "newgame". */
+	EngineProtocol(std::istream& in, std::ostream& out);
+
+	/* Destructor stops any search, and deletes the players */
+	~EngineProtocol();
+
+	EngineProtocol(const EngineProtocol&) = delete;
+	EngineProtocol& operator =(const EngineProtocol&) = delete;
+
+	/* Reads and answers commands until "quit" or the end of the input */
+	void run();
+
+	/* Answers a single command. Returns false if it was "quit". */
+	bool handle(const std::string& line);
+
+private:
+
+	std::istream& in;
+	std::ostream& out;
+
+	/* Held while writing to the output, which the search also writes to */
+	std::mutex outputLock;
+
+	/* Settings given to the players */
+	int hashMegabytes;
+	int threads;
+	std::vector<std::shared_ptr<const OpeningBook> > books;
+	std::vector<std::shared_ptr<const EndgameTable> > endgames;
+
+	/* Players of the game, one AIPlayer to a seat, so that whoever is to move
+	 * can search for their own move */
+	std::vector<Player*> players;
+	std::unique_ptr<ChainReaction> game;
+
+	/* Snapshots of the start of the game, and of the position the moves of the
+	 * game were played from, and the moves played since (as cell indices) */
+	std::vector<uint8_t> start;
+	std::vector<uint8_t> base;
+	std::vector<int> history;
+
+	/* Search running in the background, if any, and its budget. The search
+	 * stops early once stopSearch is set. */
+	std::thread searcher;
+	bool searching;
+	bool unlimited;
+	std::atomic<bool> stopSearch;
+
+	/* Handlers of the commands, each given the rest of its line */
+	void identify();
+	void setOption(std::istringstream& args);
+	void newGame(std::istringstream& args);
+	void setPosition(std::istringstream& args);
+	void playMoves(std::istringstream& args);
+	void go(std::istringstream& args);
+	void display();
+	void showSnapshot();
+
+	/* Runs the search, reporting its result when it is done */
+	void search(SearchBudget budget);
+
+	/* Waits for the search in the background to finish, if there is one,
+	 * first stopping it if asked to or if it has no limit */
+	void finishSearch(bool stop);
+
+	/* Applies the current settings to a player */
+	void configure(AIPlayer* player) const;
+
+	/* Writes a line of response, and flushes what has been written */
+	void respond(const std::string& line);
+	void flush();
+
+	/* Returns whether there is a game, reporting an error if not */
+	bool hasGame();
+
+};
+
+#endif
@@ -0,0 +1,213 @@
+/*	EngineStats.cpp
+ *
+ *	Collects and prints the engine's statistics. See EngineStats.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+#include "EngineStats.h"
+
+EngineStats::EngineStats() : nodes(0), evaluations(0), cutoffs(0), ttProbes(0), ttHits(0),
+							 moves(0), explosions(0), waves(0), longestCascade(0),
+							 deepestCascade(0), moveGenerationMilliseconds(0),
+							 cascadeMilliseconds(0), evaluationMilliseconds(0) {
+	std::fill(cutoffsByMove, cutoffsByMove + CUTOFF_SLOTS, 0);
+	std::fill(movesByExplosions, movesByExplosions + CASCADE_BUCKETS, 0);
+	std::fill(movesByWaves, movesByWaves + CASCADE_BUCKETS, 0);
+}
+
+#ifdef ENGINE_STATS
+
+/* Counters of every thread that has counted anything, and the totals of the
+ * threads that have since finished. Times are kept in ticks until they are
+ * collected. */
+struct StatsRegistry {
+	std::mutex lock;
+	std::vector<ThreadStats*> threads;
+	EngineStats finished;
+	uint64_t finishedTicks[3] = { 0, 0, 0 };
+
+	/* Ticks and time at which the registry was made, for converting ticks
+	 * to milliseconds */
+	uint64_t startTicks = statTicks();
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+};
+
+/* The registry is never destroyed, since threads may still finish (and so
+ * report to it) as the program exits */
+static StatsRegistry& registry() {
+	static StatsRegistry* stats = new StatsRegistry();
+	return *stats;
+}
+
+/* Adds the given thread's counters to the totals, and its times to the
+ * given ticks */
+static void addThread(const ThreadStats& thread, EngineStats& stats, uint64_t ticks[3]) {
+	auto get = [](const std::atomic<uint64_t>& counter) {
+		return counter.load(std::memory_order_relaxed);
+	};
+	stats.nodes += get(thread.nodes);
+	stats.evaluations += get(thread.evaluations);
+	for (int i = 0; i < CUTOFF_SLOTS; ++i)
+		stats.cutoffsByMove[i] += get(thread.cutoffsByMove[i]);
+	stats.ttProbes += get(thread.ttProbes);
+	stats.ttHits += get(thread.ttHits);
+	stats.explosions += get(thread.explosions);
+	stats.waves += get(thread.waves);
+	stats.longestCascade = std::max(stats.longestCascade, get(thread.longestCascade));
+	stats.deepestCascade = std::max(stats.deepestCascade, get(thread.deepestCascade));
+	for (int i = 0; i < CASCADE_BUCKETS; ++i) {
+		stats.movesByExplosions[i] += get(thread.movesByExplosions[i]);
+		stats.movesByWaves[i] += get(thread.movesByWaves[i]);
+	}
+	ticks[0] += get(thread.moveGenerationTicks);
+	ticks[1] += get(thread.cascadeTicks);
+	ticks[2] += get(thread.evaluationTicks);
+}
+
+ThreadStats::ThreadStats() {
+	clear();
+	StatsRegistry& stats = registry();
+	std::lock_guard<std::mutex> guard(stats.lock);
+	stats.threads.push_back(this);
+}
+
+ThreadStats::~ThreadStats() {
+	StatsRegistry& stats = registry();
+	std::lock_guard<std::mutex> guard(stats.lock);
+	addThread(*this, stats.finished, stats.finishedTicks);
+	stats.threads.erase(std::find(stats.threads.begin(), stats.threads.end(), this));
+}
+
+void ThreadStats::clear() {
+	std::atomic<uint64_t>* counters[] = { &nodes, &evaluations, &ttProbes, &ttHits,
+		&explosions, &waves, &longestCascade, &deepestCascade, &moveGenerationTicks,
+		&cascadeTicks, &evaluationTicks };
+	for (std::atomic<uint64_t>* counter : counters)
+		counter->store(0, std::memory_order_relaxed);
+	for (int i = 0; i < CUTOFF_SLOTS; ++i)
+		cutoffsByMove[i].store(0, std::memory_order_relaxed);
+	for (int i = 0; i < CASCADE_BUCKETS; ++i) {
+		movesByExplosions[i].store(0, std::memory_order_relaxed);
+		movesByWaves[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+bool statsEnabled() {
+	return true;
+}
+
+/* Totals that follow from the others are worked out here, rather than
+ * counted */
+EngineStats collectStats() {
+	StatsRegistry& stats = registry();
+	std::lock_guard<std::mutex> guard(stats.lock);
+	EngineStats total = stats.finished;
+	uint64_t ticks[3] = { stats.finishedTicks[0], stats.finishedTicks[1],
+						  stats.finishedTicks[2] };
+	for (const ThreadStats* thread : stats.threads)
+		addThread(*thread, total, ticks);
+	for (int i = 0; i < CUTOFF_SLOTS; ++i)
+		total.cutoffs += total.cutoffsByMove[i];
+	for (int i = 0; i < CASCADE_BUCKETS; ++i)
+		total.moves += total.movesByExplosions[i];
+
+	double elapsed = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - stats.startTime).count();
+	uint64_t elapsedTicks = statTicks() - stats.startTicks;
+	double msPerTick = (elapsedTicks > 0) ? elapsed / elapsedTicks : 0;
+	total.moveGenerationMilliseconds = ticks[0] * msPerTick;
+	total.cascadeMilliseconds = ticks[1] * msPerTick;
+	total.evaluationMilliseconds = ticks[2] * msPerTick;
+	return total;
+}
+
+void resetStats() {
+	StatsRegistry& stats = registry();
+	std::lock_guard<std::mutex> guard(stats.lock);
+	stats.finished = EngineStats();
+	std::fill(stats.finishedTicks, stats.finishedTicks + 3, 0);
+	for (ThreadStats* thread : stats.threads)
+		thread->clear();
+}
+
+#else
+
+bool statsEnabled() {
+	return false;
+}
+
+EngineStats collectStats() {
+	return EngineStats();
+}
+
+void resetStats() {}
+
+#endif
+
+/* Percentage of a count in a total, or zero if the total is zero */
+static double percent(uint64_t count, uint64_t total) {
+	return (total > 0) ? 100.0 * count / total : 0;
+}
+
+/* Prints the counts of the non-empty buckets, as "range: count" */
+static void printBuckets(std::ostream& out, const uint64_t* buckets, uint64_t total) {
+	for (int i = 0; i < CASCADE_BUCKETS; ++i) {
+		if (buckets[i] == 0)
+			continue;
+		uint64_t low = (i == 0) ? 0 : uint64_t(1) << (i - 1);
+		uint64_t high = (i == 0) ? 0 : (uint64_t(1) << i) - 1;
+		out << "    ";
+		if (i == CASCADE_BUCKETS - 1)
+			out << low << "+";
+		else if (low == high)
+			out << low;
+		else
+			out << low << "-" << high;
+		out << ": " << buckets[i] << " (" << percent(buckets[i], total) << "%)"
+			<< std::endl;
+	}
+}
+
+void printStats(std::ostream& out, const EngineStats& stats) {
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	out << "===== STATISTICS =====" << std::endl;
+	if (!statsEnabled()) {
+		out << "Statistics are not compiled in (build with make STATS=1)" << std::endl;
+		out.flags(flags);
+		out.precision(precision);
+		return;
+	}
+	out << "Search nodes: " << stats.nodes << std::endl;
+	out << "Evaluations: " << stats.evaluations << std::endl;
+	out << "Beta cutoffs: " << stats.cutoffs << ", by move searched:" << std::endl;
+	for (int i = 0; i < CUTOFF_SLOTS; ++i) {
+		out << "    " << i + 1 << ((i == CUTOFF_SLOTS - 1) ? "+" : "") << ": "
+			<< stats.cutoffsByMove[i] << " (" << percent(stats.cutoffsByMove[i], stats.cutoffs)
+			<< "%)" << std::endl;
+	}
+	out << "Transposition table: " << stats.ttProbes << " probes, " << stats.ttHits
+		<< " hits (" << percent(stats.ttHits, stats.ttProbes) << "%)" << std::endl;
+	double moves = (stats.moves > 0) ? stats.moves : 1;
+	out << "Moves played: " << stats.moves << std::endl;
+	out << "Explosions: " << stats.explosions << " (" << stats.explosions / moves
+		<< " a move, at most " << stats.longestCascade << "), moves by explosions:"
+		<< std::endl;
+	printBuckets(out, stats.movesByExplosions, stats.moves);
+	out << "Waves: " << stats.waves << " (" << stats.waves / moves << " a move, at most "
+		<< stats.deepestCascade << "), moves by waves:" << std::endl;
+	printBuckets(out, stats.movesByWaves, stats.moves);
+	out << "Time: move generation " << stats.moveGenerationMilliseconds << " ms, chain "
+		<< "reactions " << stats.cascadeMilliseconds << " ms, evaluation "
+		<< stats.evaluationMilliseconds << " ms" << std::endl;
+	out.flags(flags);
+	out.precision(precision);
+}
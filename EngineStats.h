@@ -0,0 +1,208 @@
+/*	EngineStats.h
+ *
+ *	Counters of what the engine spends its time on, for deciding what is worth making
+ *	faster: the nodes searched, the beta cutoffs (by the index of the move that caused
+ *	them, as a measure of move ordering), transposition table probes and hits, the
+ *	length (explosions) and depth (waves) of chain reactions, and the time spent
+ *	generating moves, resolving chain reactions and evaluating positions.
+ *
+ *	Counting is only compiled in when ENGINE_STATS is defined (make STATS=1). Otherwise
+ *	the STAT_ macros used to count expand to nothing, and statsEnabled() returns false.
+ *
+ *	Each thread counts into its own block of counters, so counting takes no locks and
+ *	no atomic read-modify-writes, and collectStats() adds up the blocks of every thread
+ *	(including threads that have since finished). Times are taken with the processor's
+ *	time stamp counter where there is one, and are converted to milliseconds when
+ *	collected.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _ENGINESTATS_H_
+#define _ENGINESTATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/* Moves up to the last slot each have their own count of cutoffs, and moves
+ * after share the last slot */
+const int CUTOFF_SLOTS = 8;
+
+/* Chain reactions are counted by their length and depth in powers of two:
+ * zero, one, two to three, four to seven, and so on */
+const int CASCADE_BUCKETS = 16;
+
+/* Statistics collected from every thread */
+struct EngineStats {
+	EngineStats();
+
+	/* Nodes visited by alpha-beta searches, and positions evaluated */
+	uint64_t nodes;
+	uint64_t evaluations;
+
+	/* Beta cutoffs, in all and by the index of the move that caused them
+	 * (counted from zero, in the order the moves were searched) */
+	uint64_t cutoffs;
+	uint64_t cutoffsByMove[CUTOFF_SLOTS];
+
+	/* Transposition table lookups, and those that found their position */
+	uint64_t ttProbes;
+	uint64_t ttHits;
+
+	/* Moves played (in games and searches alike), the explosions and waves of
+	 * their chain reactions, the most of either in a single move, and the
+	 * number of moves by the bucket of their explosions and of their waves */
+	uint64_t moves;
+	uint64_t explosions;
+	uint64_t waves;
+	uint64_t longestCascade;
+	uint64_t deepestCascade;
+	uint64_t movesByExplosions[CASCADE_BUCKETS];
+	uint64_t movesByWaves[CASCADE_BUCKETS];
+
+	/* Time spent generating moves, resolving chain reactions (which includes
+	 * placing the ball) and evaluating positions */
+	double moveGenerationMilliseconds;
+	double cascadeMilliseconds;
+	double evaluationMilliseconds;
+};
+
+/* Returns whether statistics are compiled in */
+bool statsEnabled();
+
+/* Returns the statistics counted so far */
+EngineStats collectStats();
+
+/* Sets every count back to zero. Counts made by other threads meanwhile may
+ * be lost. */
+void resetStats();
+
+/* Prints the statistics as a table */
+void printStats(std::ostream& out, const EngineStats& stats);
+
+#ifdef ENGINE_STATS
+
+/* Counters of a single thread, which only that thread adds to. Adding is a
+ * relaxed load and store rather than a read-modify-write, but the counters
+ * are atomic still, so that they may be read from other threads. */
+struct ThreadStats {
+	ThreadStats();
+	~ThreadStats();
+
+	ThreadStats(const ThreadStats&) = delete;
+	ThreadStats& operator =(const ThreadStats&) = delete;
+
+	std::atomic<uint64_t> nodes;
+	std::atomic<uint64_t> evaluations;
+	std::atomic<uint64_t> cutoffsByMove[CUTOFF_SLOTS];
+	std::atomic<uint64_t> ttProbes;
+	std::atomic<uint64_t> ttHits;
+	std::atomic<uint64_t> explosions;
+	std::atomic<uint64_t> waves;
+	std::atomic<uint64_t> longestCascade;
+	std::atomic<uint64_t> deepestCascade;
+	std::atomic<uint64_t> movesByExplosions[CASCADE_BUCKETS];
+	std::atomic<uint64_t> movesByWaves[CASCADE_BUCKETS];
+	std::atomic<uint64_t> moveGenerationTicks;
+	std::atomic<uint64_t> cascadeTicks;
+	std::atomic<uint64_t> evaluationTicks;
+
+	/* Sets every counter to zero */
+	void clear();
+
+	/* The calling thread's counters */
+	static ThreadStats& local() {
+		static thread_local ThreadStats stats;
+		return stats;
+	}
+
+	static void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+		counter.store(counter.load(std::memory_order_relaxed) + amount,
+					  std::memory_order_relaxed);
+	}
+
+	static void raise(std::atomic<uint64_t>& counter, uint64_t value) {
+		if (value > counter.load(std::memory_order_relaxed))
+			counter.store(value, std::memory_order_relaxed);
+	}
+
+	/* Bucket of a length or depth, by its number of bits */
+	static int bucket(uint64_t value) {
+		int bits = (value == 0) ? 0 : 64 - __builtin_clzll(value);
+		return (bits < CASCADE_BUCKETS) ? bits : CASCADE_BUCKETS - 1;
+	}
+
+	/* Counts a chain reaction of the given number of explosions and waves */
+	void countCascade(int explosionCount, int waveCount) {
+		add(explosions, explosionCount);
+		add(waves, waveCount);
+		raise(longestCascade, explosionCount);
+		raise(deepestCascade, waveCount);
+		add(movesByExplosions[bucket(explosionCount)], 1);
+		add(movesByWaves[bucket(waveCount)], 1);
+	}
+
+	/* Counts a cutoff caused by the move of the given index */
+	void countCutoff(int move) {
+		add(cutoffsByMove[(move < CUTOFF_SLOTS) ? move : CUTOFF_SLOTS - 1], 1);
+	}
+};
+
+/* Reads the time stamp counter, or the time in nanoseconds where there is none */
+inline uint64_t statTicks() {
+#if defined(__x86_64__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Adds the ticks from its construction to its destruction to a counter,
+ * leaving out any time it is paused for */
+class StatTimer {
+public:
+	StatTimer(std::atomic<uint64_t>& counter) : counter(counter), start(statTicks()),
+												running(true) {}
+	~StatTimer() { pause(); }
+	void pause() {
+		if (running)
+			ThreadStats::add(counter, statTicks() - start);
+		running = false;
+	}
+	void resume() {
+		start = statTicks();
+		running = true;
+	}
+private:
+	std::atomic<uint64_t>& counter;
+	uint64_t start;
+	bool running;
+};
+
+#define STAT_ADD(counter, amount) ThreadStats::add(ThreadStats::local().counter, (amount))
+#define STAT_CUTOFF(move) ThreadStats::local().countCutoff(move)
+#define STAT_CASCADE(explosions, waves) ThreadStats::local().countCascade((explosions), (waves))
+#define STAT_TIMER(timer, counter) StatTimer timer(ThreadStats::local().counter)
+#define STAT_PAUSE(timer) timer.pause()
+#define STAT_RESUME(timer) timer.resume()
+
+#else
+
+#define STAT_ADD(counter, amount) ((void)0)
+#define STAT_CUTOFF(move) ((void)(move))
+#define STAT_CASCADE(explosions, waves) ((void)0)
+#define STAT_TIMER(timer, counter) ((void)0)
+#define STAT_PAUSE(timer) ((void)0)
+#define STAT_RESUME(timer) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,291 @@
+/*	GameJournal.cpp
+ *
+ *	Records games, writes them to journals, and reads them back. See GameJournal.h
+ *	for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include "ChainReaction.h"
+#include "GameJournal.h"
+#include "Snapshot.h"
+
+/* Header at the start of a journal file, marking it as a journal, and the
+ * version of its layout */
+struct JournalHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+static const char JOURNAL_MAGIC[8] = { 'C', 'R', 'J', 'R', 'N', 'L', '\0', '\0' };
+static const uint32_t JOURNAL_VERSION = 1;
+
+/* Marks the start of each game, as a check that the reader is where it
+ * expects to be */
+static const uint32_t GAME_MARKER = 0x454d4147;
+
+/* Size of the buffers of writers and readers */
+static const std::size_t BUFFER_BYTES = 1 << 20;
+
+/* Snapshots follow every snapshotInterval moves, including the last */
+static int64_t moveOffset(const JournalGame& game, std::size_t snapshotSize, int move) {
+	int64_t offset = (int64_t)move * sizeof(JournalMove);
+	if (game.snapshotInterval > 0)
+		offset += (int64_t)(move / game.snapshotInterval) * snapshotSize;
+	return offset;
+}
+
+/* ===== GameRecord =====*/
+
+GameRecord::GameRecord(const ChainReaction& game, int snapshotInterval) :
+					   toMove(game.current) {
+	memset(&info, 0, sizeof(info));
+	info.marker = GAME_MARKER;
+	info.rows = game.rows;
+	info.cols = game.cols;
+	info.players = game.players.size();
+	info.winner = NO_PLAYER;
+	info.snapshotInterval = std::max(0, snapshotInterval);
+}
+
+/* The mover is whoever's turn it was before the move */
+void GameRecord::addMove(const ChainReaction& game, int row, int col) {
+	JournalMove move;
+	move.cell = game.index(row, col);
+	move.player = toMove;
+	move.waves = std::min(game.lastCascade().waves, 255);
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&move);
+	data.insert(data.end(), bytes, bytes + sizeof(move));
+	toMove = game.current;
+	++info.moves;
+	if (info.snapshotInterval > 0 && info.moves % info.snapshotInterval == 0) {
+		Snapshot::save(game, snapshot);
+		data.insert(data.end(), snapshot.begin(), snapshot.end());
+	}
+}
+
+void GameRecord::finish(const ChainReaction& game) {
+	info.winner = game.gameOver() ? game.playerId(game.winner) : NO_PLAYER;
+}
+
+/* ===== GameJournal =====*/
+
+GameJournal::GameJournal() : file(nullptr) {}
+
+GameJournal::~GameJournal() {
+	close();
+}
+
+/* A new (empty) file is given a header; a file with anything in it must
+ * already be a journal. Writes always go to the end of the file, but the
+ * stream is still moved there after reading the header, as a stream can't
+ * go from reading to writing without a seek. */
+bool GameJournal::open(const std::string& path) {
+	close();
+	FILE* opened = fopen(path.c_str(), "a+b");
+	if (opened == nullptr)
+		return false;
+	JournalHeader header;
+	if (fread(&header, sizeof(header), 1, opened) == 1) {
+		if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+			|| header.version != JOURNAL_VERSION || fseek(opened, 0, SEEK_END) != 0) {
+			fclose(opened);
+			return false;
+		}
+	} else {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+		header.version = JOURNAL_VERSION;
+		if (fwrite(&header, sizeof(header), 1, opened) != 1 || fflush(opened) != 0) {
+			fclose(opened);
+			return false;
+		}
+	}
+	file = opened;
+	buffer.reserve(BUFFER_BYTES);
+	return true;
+}
+
+void GameJournal::close() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (file != nullptr) {
+		flushBuffer();
+		fclose(file);
+	}
+	file = nullptr;
+}
+
+/* A game bigger than the whole buffer is written straight out */
+bool GameJournal::write(const GameRecord& record) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (file == nullptr)
+		return false;
+	const JournalGame& header = record.header();
+	const std::vector<uint8_t>& body = record.body();
+	if (buffer.size() + sizeof(header) + body.size() > BUFFER_BYTES && !flushBuffer())
+		return false;
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(header));
+	buffer.insert(buffer.end(), body.begin(), body.end());
+	if (buffer.size() > BUFFER_BYTES)
+		return flushBuffer();
+	return true;
+}
+
+bool GameJournal::flush() {
+	std::lock_guard<std::mutex> guard(lock);
+	return file != nullptr && flushBuffer();
+}
+
+bool GameJournal::flushBuffer() {
+	bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size()
+		&& fflush(file) == 0;
+	buffer.clear();
+	return written;
+}
+
+/* ===== JournalReader =====*/
+
+JournalReader::JournalReader() : file(nullptr), position(0), gameStart(-1), movesRead(0),
+								 numGames(0), fileSize(0), snapshotSize(0) {
+	memset(&current, 0, sizeof(current));
+}
+
+JournalReader::~JournalReader() {
+	close();
+}
+
+bool JournalReader::open(const std::string& path) {
+	close();
+	FILE* opened = fopen(path.c_str(), "rb");
+	if (opened == nullptr)
+		return false;
+	buffer.resize(BUFFER_BYTES);
+	setvbuf(opened, buffer.data(), _IOFBF, buffer.size());
+	struct stat status;
+	JournalHeader header;
+	if (fstat(fileno(opened), &status) != 0
+		|| fread(&header, sizeof(header), 1, opened) != 1
+		|| memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+		|| header.version != JOURNAL_VERSION) {
+		fclose(opened);
+		return false;
+	}
+	file = opened;
+	fileSize = status.st_size;
+	position = sizeof(header);
+	return true;
+}
+
+void JournalReader::close() {
+	if (file != nullptr)
+		fclose(file);
+	file = nullptr;
+	memset(&current, 0, sizeof(current));
+	gameStart = -1;
+	movesRead = 0;
+	numGames = 0;
+	position = 0;
+}
+
+/* The next game starts where the moves and snapshots of this one end. It is
+ * only read if the whole of it is in the file. Once a game can't be read,
+ * the reader is left at the end of the file, as nothing after it can be
+ * trusted. */
+bool JournalReader::nextGame() {
+	if (file == nullptr || position >= fileSize)
+		return false;
+	JournalGame header;
+	if ((gameStart < 0 || seekTo(gameBytes()))
+		&& fread(&header, sizeof(header), 1, file) == 1 && header.marker == GAME_MARKER) {
+		position += sizeof(header);
+		current = header;
+		gameStart = position;
+		movesRead = 0;
+		snapshotSize = Snapshot::size(header.rows, header.cols, header.players);
+		if (gameStart + gameBytes() <= fileSize) {
+			++numGames;
+			return true;
+		}
+	}
+	gameStart = -1;
+	position = fileSize;
+	return false;
+}
+
+/* A snapshot after the move just read is stepped over by the next read */
+bool JournalReader::nextMove(JournalMove& move) {
+	if (gameStart < 0 || movesRead >= (int)current.moves)
+		return false;
+	if (!seekTo(moveOffset(movesRead)) || fread(&move, sizeof(move), 1, file) != 1)
+		return false;
+	position += sizeof(move);
+	++movesRead;
+	return true;
+}
+
+/* The game is restored from the last snapshot at or before the move, or set
+ * back to the empty board if there is none, and the moves since are played
+ * out on it */
+bool JournalReader::seek(int moves, ChainReaction& game) {
+	if (gameStart < 0 || moves < 0 || moves > (int)current.moves
+		|| game.rows != current.rows || game.cols != current.cols
+		|| (int)game.players.size() != current.players)
+		return false;
+	int from = (current.snapshotInterval > 0) ? moves / current.snapshotInterval
+		* current.snapshotInterval : 0;
+	if (from > 0) {
+		if (!seekTo(moveOffset(from) - snapshotSize))
+			return false;
+		scratch.resize(snapshotSize);
+		if (fread(scratch.data(), 1, snapshotSize, file) != snapshotSize)
+			return false;
+		position += snapshotSize;
+	} else {
+		ChainReaction start(game.rows, game.cols, game.players);
+		Snapshot::save(start, scratch);
+	}
+	if (!Snapshot::restore(scratch.data(), scratch.size(), game))
+		return false;
+	movesRead = from;
+	JournalMove move;
+	while (movesRead < moves) {
+		if (!nextMove(move)
+			|| !game.playerMove(move.cell / game.cols, move.cell % game.cols,
+								game.currentPlayer()))
+			return false;
+	}
+	return true;
+}
+
+int64_t JournalReader::moveOffset(int move) const {
+	return ::moveOffset(current, snapshotSize, move);
+}
+
+int64_t JournalReader::gameBytes() const {
+	return moveOffset(current.moves);
+}
+
+/* Reading straight on needs no seek, which would throw away the buffer, and
+ * neither does stepping over a snapshot, which is read past instead */
+bool JournalReader::seekTo(int64_t offset) {
+	int64_t target = gameStart + offset;
+	if (target == position)
+		return true;
+	if (target > position && target - position <= (int64_t)snapshotSize) {
+		std::size_t skipped = target - position;
+		scratch.resize(skipped);
+		if (fread(scratch.data(), 1, skipped, file) != skipped)
+			return false;
+	} else if (fseeko(file, target, SEEK_SET) != 0) {
+		return false;
+	}
+	position = target;
+	return true;
+}
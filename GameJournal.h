@@ -0,0 +1,215 @@
+/*	GameJournal.h
+ *
+ *	A journal of every game played, for auditing games after the fact and as data
+ *	for training and tuning the AI. A journal is a file that games are only ever
+ *	appended to, each as a header followed by a fixed-size record for each of its
+ *	moves, in the order they were played.
+ *
+ *	Every so often (every SNAPSHOT_INTERVAL moves, by default), the moves of a game are
+ *	followed by a Snapshot (see Snapshot.h) of the position they lead to. Since the
+ *	moves and snapshots are all of a fixed size for a given game, where any move or
+ *	snapshot lies in the file follows from its number alone, so a reader can go to
+ *	the position after any move by restoring the last snapshot before it and playing
+ *	only the moves since, rather than replaying the game from its first move.
+ *
+ *	A game is recorded in memory as it is played (by a GameRecord), and written to the
+ *	journal as a whole once it is over, so the games of a journal are never interleaved
+ *	even when games are played on many threads at once. The journal buffers what is
+ *	written to it, and only writes to the file when its buffer fills up, or when it
+ *	is flushed or closed. A game cut short at the end of a file (by a crash) is
+ *	ignored by readers.
+ *
+ *	Readers stream through a journal a game and a move at a time, reading the file
+ *	through a buffer, so journals of millions of games can be read without holding
+ *	them in memory. As with opening books, numbers are in the byte order of the
+ *	machine that wrote them.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _GAMEJOURNAL_H_
+#define _GAMEJOURNAL_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Board.h"
+
+class ChainReaction;
+
+/* Number of moves between snapshots, by default */
+const int SNAPSHOT_INTERVAL = 64;
+
+/* A move of a recorded game: the cell the ball was placed in, the player who
+ * placed it, and the number of waves of the chain reaction it set off (up to
+ * 255) */
+struct JournalMove {
+	uint16_t cell;
+	PlayerId player;
+	uint8_t waves;
+};
+
+/* Header of a recorded game: the size of the board, the number of players,
+ * the winner (or NO_PLAYER if the game was quit), the number of moves
+ * between snapshots (zero for none), and the number of moves played */
+struct JournalGame {
+	uint32_t marker;
+	uint16_t rows;
+	uint16_t cols;
+	uint8_t players;
+	PlayerId winner;
+	uint16_t snapshotInterval;
+	uint32_t moves;
+};
+
+/* Record of a single game, kept in memory while it is played */
+class GameRecord {
+public:
+
+	/* Constructor starts the record of the given game, which must not have
+	 * had any moves played yet */
+	GameRecord(const ChainReaction& game, int snapshotInterval = SNAPSHOT_INTERVAL);
+
+	/* Records the move just played in the given game at the given position,
+	 * taking a snapshot of the game if one is due. Every move of the game
+	 * must be recorded, as the player who played it is taken to be the one
+	 * whose turn it was after the last move recorded. */
+	void addMove(const ChainReaction& game, int row, int col);
+
+	/* Records the winner of the game, if it is over */
+	void finish(const ChainReaction& game);
+
+	/* Header and moves (and snapshots) of the game */
+	const JournalGame& header() const { return info; }
+	const std::vector<uint8_t>& body() const { return data; }
+
+private:
+
+	JournalGame info;
+	std::vector<uint8_t> data;
+
+	/* Whose turn it is in the game, after the last move recorded */
+	PlayerId toMove;
+
+	/* Buffer for the snapshots of the game */
+	std::vector<uint8_t> snapshot;
+
+};
+
+/* Writes games to a journal */
+class GameJournal {
+public:
+
+	/* Constructor creates a journal writing nowhere, until one is opened */
+	GameJournal();
+
+	/* Destructor closes the journal */
+	~GameJournal();
+
+	GameJournal(const GameJournal&) = delete;
+	GameJournal& operator =(const GameJournal&) = delete;
+
+	/* Opens the journal at the given path, which is created if it doesn't
+	 * exist and added to if it does. Closes any journal already open. Returns
+	 * false if the file can't be opened, or isn't a journal. */
+	bool open(const std::string& path);
+
+	/* Writes out what is buffered, and closes the file */
+	void close();
+
+	/* Adds the game to the journal. Games may be written from any number of
+	 * threads at once. Returns false if the journal couldn't be written to. */
+	bool write(const GameRecord& record);
+
+	/* Writes out what is buffered. Returns false if it couldn't be. */
+	bool flush();
+
+private:
+
+	FILE* file;
+	std::vector<uint8_t> buffer;
+	std::mutex lock;
+
+	/* Writes out the buffer, with the lock held */
+	bool flushBuffer();
+
+};
+
+/* Reads the games of a journal in order, a move at a time */
+class JournalReader {
+public:
+
+	/* Constructor creates a reader with nothing to read, until a journal is
+	 * opened */
+	JournalReader();
+
+	/* Destructor closes the journal */
+	~JournalReader();
+
+	JournalReader(const JournalReader&) = delete;
+	JournalReader& operator =(const JournalReader&) = delete;
+
+	/* Opens the journal at the given path, closing any journal already open,
+	 * and sets the reader before its first game. Returns false if the file
+	 * can't be opened, or isn't a journal. */
+	bool open(const std::string& path);
+
+	/* Closes the journal */
+	void close();
+
+	/* Moves on to the next game of the journal, skipping any moves of the
+	 * current game not read yet. Returns false if there are no more games
+	 * (or the next is cut short). */
+	bool nextGame();
+
+	/* Header of the current game, and the number of games read so far */
+	const JournalGame& game() const { return current; }
+	uint64_t gamesRead() const { return numGames; }
+
+	/* Reads the next move of the current game. Returns false once every move
+	 * has been read. */
+	bool nextMove(JournalMove& move);
+
+	/* Restores the given game, which must be of the size and number of players
+	 * of the current game, to the position after the given number of moves of
+	 * the current game, starting from the last snapshot before it. The next
+	 * move read is then the one after. Returns false if the game doesn't have
+	 * that many moves, or the journal can't be read. */
+	bool seek(int moves, ChainReaction& game);
+
+private:
+
+	FILE* file;
+	std::vector<char> buffer;
+
+	/* Offset of the next byte to be read from the file, and space for the
+	 * snapshots read from it */
+	int64_t position;
+	std::vector<uint8_t> scratch;
+
+	/* Header of the current game, where its moves start in the file, and the
+	 * number of its moves read so far */
+	JournalGame current;
+	int64_t gameStart;
+	int movesRead;
+	uint64_t numGames;
+
+	/* Size of the file, and of each snapshot of the current game */
+	int64_t fileSize;
+	std::size_t snapshotSize;
+
+	/* Offset of the given move of the current game from the start of its moves,
+	 * and the number of bytes of its moves and snapshots */
+	int64_t moveOffset(int move) const;
+	int64_t gameBytes() const;
+
+	/* Moves the file to the given offset from the start of the current game's
+	 * moves */
+	bool seekTo(int64_t offset);
+
+};
+
+#endif
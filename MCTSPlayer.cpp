@@ -0,0 +1,342 @@
+/*	MCTSPlayer.cpp
+ *
+ *	Implements a Monte Carlo tree search player for ChainReaction. See MCTSPlayer.h
+ *	for more information.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+
+#include "MCTSPlayer.h"
+
+/* Number of playouts between readings of the clock */
+const int PLAYOUT_INTERVAL = 64;
+
+/* Number of moves, beyond the root, to look for the game's position in when
+ * reusing the tree */
+const int REUSE_DEPTH = 8;
+
+/* Searches with the player's own budget */
+bool MCTSPlayer::chooseMove(ChainReaction& game, int& row, int& col) {
+	Position move = search(game, defaultBudget);
+	row = move.row;
+	col = move.col;
+	return true;
+}
+
+/* Seed of a thread's random number generator, for a search of the position
+ * of the given hash: one step of SplitMix64 over the two, so that threads
+ * play different playouts (and so grow different trees), while a search of
+ * the same position on the same thread always plays the same ones. The
+ * xorshift generator can't be seeded with zero. */
+static uint64_t threadSeed(uint64_t hash, int thread) {
+	uint64_t seed = hash + (thread + 1) * 0x9e3779b97f4a7c15ULL;
+	seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+	seed ^= seed >> 31;
+	return (seed != 0) ? seed : 0x853c49e6748fea9bULL;
+}
+
+/* Each thread reuses (or starts) its tree, seeds its random numbers, and
+ * grows it on its own copy of the game, the first thread using the game
+ * itself. The move chosen is the one with the most visits over the roots of
+ * all trees. */
+Position MCTSPlayer::search(ChainReaction& game, const SearchBudget& budget) {
+	auto start = std::chrono::steady_clock::now();
+	info = MCTSInfo();
+	trees.resize(numThreads);
+
+	std::vector<std::unique_ptr<ChainReaction> > games;
+	games.emplace_back(nullptr);
+	for (int i = 1; i < numThreads; ++i) {
+		games.emplace_back(new ChainReaction(game));
+	}
+	std::vector<uint64_t> playouts(numThreads, 0);
+	uint64_t hash = game.hash();
+	for (int i = 0; i < numThreads; ++i) {
+		ChainReaction& threadGame = (i == 0) ? game : *games[i];
+		info.reusedNodes += reuseTree(trees[i], threadGame);
+		trees[i].random = threadSeed(hash, i);
+	}
+
+	/* Each thread gets an equal share of any playout limit */
+	uint64_t playoutLimit = 0;
+	if (budget.nodes != 0)
+		playoutLimit = (budget.nodes + numThreads - 1) / numThreads;
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; ++i) {
+		threads.emplace_back([this, i, &games, &budget, playoutLimit, &playouts]() {
+			grow(trees[i], *games[i], budget, playoutLimit, playouts[i]);
+		});
+	}
+	grow(trees[0], game, budget, playoutLimit, playouts[0]);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	/* Adds up the visits of each move over the roots of the trees */
+	std::vector<int> visits(game.board.size(), 0);
+	for (const Tree& tree : trees) {
+		const Node& root = tree.nodes[0];
+		for (int i = 0; i < root.numChildren; ++i) {
+			const Node& child = tree.nodes[root.firstChild + i];
+			visits[child.move] += child.visits;
+		}
+		info.nodes += tree.nodes.size();
+	}
+	Position bestMove;
+	int bestVisits = -1;
+	game.forEachValidMove(game.currentPlayer(), [&](int row, int col) {
+		if (visits[game.index(row, col)] > bestVisits) {
+			bestVisits = visits[game.index(row, col)];
+			bestMove.set(row, col);
+		}
+		return true;
+	});
+
+	for (uint64_t threadPlayouts : playouts) {
+		info.playouts += threadPlayouts;
+	}
+	info.milliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+	return bestMove;
+}
+
+/* Sets the default budget */
+void MCTSPlayer::setBudget(const SearchBudget& budget) {
+	defaultBudget = budget;
+}
+
+/* Sets the number of threads, which is also the number of trees */
+void MCTSPlayer::setThreads(int threads) {
+	numThreads = (threads < 1) ? 1 : threads;
+}
+
+/* Sets the exploration weight */
+void MCTSPlayer::setExploration(double exploration) {
+	this->exploration = exploration;
+}
+
+/* Sets the playout policy */
+void MCTSPlayer::setPlayoutPolicy(PlayoutPolicy policy) {
+	this->policy = policy;
+}
+
+/* Returns the information on the last search */
+const MCTSInfo& MCTSPlayer::lastSearch() const {
+	return info;
+}
+
+/* ===== Private Functions =====*/
+
+/* Looks for a visited node with the game's hash, breadth first, down to
+ * REUSE_DEPTH moves below the root. If one is found, its subtree is copied
+ * into a new tree, breadth first, with the node as its root. */
+uint64_t MCTSPlayer::reuseTree(Tree& tree, ChainReaction& game) {
+	uint64_t hash = game.hash();
+	int found = -1;
+	if (!tree.nodes.empty()) {
+		std::vector<int> level(1, 0);
+		for (int depth = 0; depth <= REUSE_DEPTH && found < 0 && !level.empty(); ++depth) {
+			std::vector<int> nextLevel;
+			for (int node : level) {
+				if (tree.nodes[node].visits > 0 && tree.nodes[node].hash == hash) {
+					found = node;
+					break;
+				}
+				for (int i = 0; i < tree.nodes[node].numChildren; ++i) {
+					nextLevel.push_back(tree.nodes[node].firstChild + i);
+				}
+			}
+			level.swap(nextLevel);
+		}
+	}
+
+	std::vector<Node> nodes;
+	if (found >= 0) {
+		nodes.push_back(tree.nodes[found]);
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			/* Pushing the children may move the node, so it is read first */
+			int oldFirst = nodes[i].firstChild;
+			int numChildren = nodes[i].numChildren;
+			if (numChildren > 0)
+				nodes[i].firstChild = nodes.size();
+			for (int j = 0; j < numChildren; ++j) {
+				nodes.push_back(tree.nodes[oldFirst + j]);
+			}
+		}
+	} else {
+		Node root = { hash, nullptr, -1, 0, -1, 0, 0 };
+		nodes.push_back(root);
+	}
+	tree.nodes.swap(nodes);
+	return (found >= 0) ? tree.nodes.size() : 0;
+}
+
+/* Runs iterations, checking the clock every PLAYOUT_INTERVAL playouts */
+void MCTSPlayer::grow(Tree& tree, ChainReaction& game, const SearchBudget& budget,
+					  uint64_t playoutLimit, uint64_t& playouts) {
+	auto deadline = std::chrono::steady_clock::now()
+					+ std::chrono::milliseconds(budget.milliseconds);
+	std::vector<int> path;
+	if (tree.nodes[0].numChildren < 0 && !game.gameOver())
+		expand(tree, 0, game);
+	while (true) {
+		iterate(tree, game, path);
+		++playouts;
+		if (playoutLimit != 0 && playouts >= playoutLimit)
+			break;
+		if (budget.milliseconds > 0 && playouts % PLAYOUT_INTERVAL == 0
+			&& std::chrono::steady_clock::now() >= deadline)
+			break;
+		if (budget.milliseconds <= 0 && playoutLimit == 0)
+			break;
+	}
+}
+
+/* Nodes are expanded on their second visit, so that the tree only grows
+ * where playouts keep coming back to */
+void MCTSPlayer::iterate(Tree& tree, ChainReaction& game, std::vector<int>& path) {
+	path.clear();
+	path.push_back(0);
+	int node = 0;
+	while (tree.nodes[node].numChildren > 0 && !game.gameOver()) {
+		node = select(tree, node);
+		int move = tree.nodes[node].move;
+		game.makeMove(move / game.cols, move % game.cols);
+		path.push_back(node);
+		if (tree.nodes[node].visits == 0) {
+			tree.nodes[node].hash = game.hash();
+			break;
+		}
+	}
+	if (tree.nodes[node].numChildren < 0 && tree.nodes[node].visits > 0
+		&& !game.gameOver() && tree.nodes.size() < (size_t)MAX_TREE_NODES) {
+		expand(tree, node, game);
+		if (tree.nodes[node].numChildren > 0) {
+			node = tree.nodes[node].firstChild;
+			int move = tree.nodes[node].move;
+			game.makeMove(move / game.cols, move % game.cols);
+			tree.nodes[node].hash = game.hash();
+			path.push_back(node);
+		}
+	}
+
+	std::vector<double> scores(game.players.size() + 1, 0);
+	playout(tree, game, scores);
+	for (int pathNode : path) {
+		Node& visited = tree.nodes[pathNode];
+		++visited.visits;
+		if (visited.mover != nullptr)
+			visited.reward += scores[game.playerId(visited.mover)];
+	}
+	for (size_t i = 1; i < path.size(); ++i) {
+		game.unmakeMove();
+	}
+}
+
+/* Children are appended to the end of the tree, in the order of the
+ * game's valid moves */
+void MCTSPlayer::expand(Tree& tree, int node, ChainReaction& game) {
+	Player* mover = game.currentPlayer();
+	int firstChild = tree.nodes.size();
+	game.forEachValidMove(mover, [&](int row, int col) {
+		Node child = { 0, mover, game.index(row, col), 0, -1, 0, 0 };
+		tree.nodes.push_back(child);
+		return true;
+	});
+	tree.nodes[node].firstChild = firstChild;
+	tree.nodes[node].numChildren = tree.nodes.size() - firstChild;
+}
+
+/* Unvisited children are always selected first. Otherwise the child with
+ * the highest mean reward plus exploration bonus is selected. */
+int MCTSPlayer::select(const Tree& tree, int node) const {
+	const Node& parent = tree.nodes[node];
+	double logVisits = std::log((double)parent.visits + 1);
+	int best = parent.firstChild;
+	double bestValue = -1;
+	for (int i = 0; i < parent.numChildren; ++i) {
+		const Node& child = tree.nodes[parent.firstChild + i];
+		if (child.visits == 0)
+			return parent.firstChild + i;
+		double value = child.reward / child.visits
+					   + exploration * std::sqrt(logVisits / child.visits);
+		if (value > bestValue) {
+			bestValue = value;
+			best = parent.firstChild + i;
+		}
+	}
+	return best;
+}
+
+/* A finished game scores one for the winner. A playout cut short scores
+ * each player their share of the balls on the board. */
+void MCTSPlayer::playout(Tree& tree, ChainReaction& game, std::vector<double>& scores) {
+	int limit = 2 * game.board.size() + 32;
+	int moves = 0;
+	while (!game.gameOver() && moves < limit) {
+		int move = playoutMove(tree, game);
+		if (move < 0)
+			break;
+		game.makeMove(move / game.cols, move % game.cols);
+		++moves;
+	}
+	if (game.gameOver()) {
+		if (game.winner != nullptr)
+			scores[game.playerId(game.winner)] = 1;
+	} else if (game.totalBalls > 0) {
+		for (size_t id = 1; id < scores.size(); ++id) {
+			scores[id] = (double)game.numberOfBalls(game.players[id - 1]) / game.totalBalls;
+		}
+	}
+	for (int i = 0; i < moves; ++i) {
+		game.unmakeMove();
+	}
+}
+
+/* Picks the k-th of the player's critical cells or valid moves, for a random
+ * k, by going through them in order. Returns -1 if there is no valid move. */
+int MCTSPlayer::playoutMove(Tree& tree, ChainReaction& game) {
+	Player* player = game.currentPlayer();
+	uint64_t random = nextRandom(tree);
+	int critical = game.evalTerm(player, ChainReaction::CRITICAL_CELLS);
+	int move = -1;
+	if (policy == CRITICAL_PLAYOUTS && critical > 0 && (random & 1)) {
+		int k = (random >> 1) % critical;
+		game.forEachValidMove(player, [&](int row, int col) {
+			int cell = game.index(row, col);
+			if (game.board.owner(cell) != NO_PLAYER && game.isCritical(cell) && k-- == 0) {
+				move = cell;
+				return false;
+			}
+			return true;
+		});
+		if (move >= 0)
+			return move;
+	}
+	int count = game.numberOfValidMoves(player);
+	if (count == 0)
+		return -1;
+	int k = (random >> 1) % count;
+	game.forEachValidMove(player, [&](int row, int col) {
+		if (k-- == 0) {
+			move = game.index(row, col);
+			return false;
+		}
+		return true;
+	});
+	return move;
+}
+
+/* xorshift64* generator */
+uint64_t MCTSPlayer::nextRandom(Tree& tree) {
+	tree.random ^= tree.random >> 12;
+	tree.random ^= tree.random << 25;
+	tree.random ^= tree.random >> 27;
+	return tree.random * 0x2545f4914f6cdd1dULL;
+}
@@ -0,0 +1,153 @@
+/*	MCTSPlayer.h
+ *
+ *	This extends the Player class for a game of ChainReaction to a non-human player
+ *	which uses Monte Carlo tree search, as an alternative to the alpha-beta search of
+ *	AIPlayer. Rather than evaluating positions a fixed number of moves ahead, it plays
+ *	many quick games ("playouts") from the current position, and grows a tree of the
+ *	moves that lead to the most wins, choosing which moves to explore with the UCT
+ *	formula (the upper confidence bound of the move's win rate).
+ *
+ *	Playouts end when the game is over, or after a number of moves, in which case
+ *	each player scores their share of the balls on the board. The tree is kept from
+ *	one move to the next: the node of the position the game has reached is found
+ *	by its hash, and its subtree becomes the new tree.
+ *
+ *	Searches may run on several threads ("root parallel"): each thread grows its own
+ *	tree on its own copy of the game, and the visits of the moves at the roots of the
+ *	trees are added up to choose the move.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _MCTSPLAYER_H_
+#define _MCTSPLAYER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "AIPlayer.h"
+#include "ChainReaction.h"
+#include "Player.h"
+
+/* How moves are chosen during playouts: uniformly at random among the valid
+ * moves, or preferring to add to the player's own critical cells (half of the
+ * time, when they have any), which start chain reactions */
+enum PlayoutPolicy { RANDOM_PLAYOUTS, CRITICAL_PLAYOUTS };
+
+/* Default weight of exploration against exploitation in the UCT formula */
+const double EXPLORATION = 1.4;
+
+/* Maximum number of nodes in each thread's tree. Once full, the tree stops
+ * growing, but playouts go on from its leaves. */
+const int MAX_TREE_NODES = 1 << 22;
+
+/* Information about the last search: the number of playouts (by all threads),
+ * the number of nodes in the trees, and of those how many were kept from the
+ * previous search, and the time taken */
+struct MCTSInfo {
+	MCTSInfo() : playouts(0), nodes(0), reusedNodes(0), milliseconds(0) {}
+
+	/* Returns the number of playouts per second */
+	double playoutsPerSecond() const {
+		return (milliseconds > 0) ? 1000 * playouts / milliseconds : 0;
+	}
+
+	uint64_t playouts;
+	uint64_t nodes;
+	uint64_t reusedNodes;
+	double milliseconds;
+};
+
+class MCTSPlayer : public Player {
+public:
+
+	/* Constructor */
+	using Player::Player;
+
+	/* Searches for the best move with the player's own budget */
+	bool chooseMove(ChainReaction& game, int& row, int& col);
+
+	/* Searches for the best move within the given budget. The node limit of the
+	 * budget is the number of playouts, and its depth is not used. */
+	Position search(ChainReaction& game, const SearchBudget& budget);
+
+	/* Sets the budget used for searches that aren't given one */
+	void setBudget(const SearchBudget& budget);
+
+	/* Sets the number of threads to search with (at least one) */
+	void setThreads(int threads);
+
+	/* Sets the weight of exploration in the UCT formula */
+	void setExploration(double exploration);
+
+	/* Sets how moves are chosen in playouts */
+	void setPlayoutPolicy(PlayoutPolicy policy);
+
+	/* Returns information about the last search */
+	const MCTSInfo& lastSearch() const;
+
+private:
+
+	/* Node of a search tree, for the position reached by a move. Children are
+	 * stored next to each other, and created all at once when the node is
+	 * expanded. The reward is the total score of the player who made the move,
+	 * over every playout through the node. */
+	struct Node {
+		uint64_t hash;
+		Player* mover;
+		int move;
+		int firstChild;
+		int numChildren;
+		int visits;
+		double reward;
+	};
+
+	/* Search tree of one thread, along with its random number generator
+	 * (seeded for each search, by the thread and position) */
+	struct Tree {
+		std::vector<Node> nodes;
+		uint64_t random = 0x853c49e6748fea9bULL;
+	};
+
+	SearchBudget defaultBudget;
+	int numThreads = 1;
+	double exploration = EXPLORATION;
+	PlayoutPolicy policy = CRITICAL_PLAYOUTS;
+	MCTSInfo info;
+
+	/* Trees of each thread, kept between searches */
+	std::vector<Tree> trees;
+
+	/* Replaces the tree with the subtree of the position the game is in, if the
+	 * tree holds it within a few moves of its root, or with a new tree otherwise.
+	 * Returns the number of nodes kept. */
+	uint64_t reuseTree(Tree& tree, ChainReaction& game);
+
+	/* Runs playouts on the given tree and game until the budget runs out */
+	void grow(Tree& tree, ChainReaction& game, const SearchBudget& budget,
+			  uint64_t playoutLimit, uint64_t& playouts);
+
+	/* Runs a single iteration: selects a path down the tree, expands its leaf,
+	 * plays out the rest of the game and adds the result to the path */
+	void iterate(Tree& tree, ChainReaction& game, std::vector<int>& path);
+
+	/* Creates the children of a node, one for each valid move */
+	void expand(Tree& tree, int node, ChainReaction& game);
+
+	/* Returns the child of a node with the highest UCT value */
+	int select(const Tree& tree, int node) const;
+
+	/* Plays moves by the playout policy until the game ends or the playout
+	 * limit is reached, then takes them all back. Fills in the score of each
+	 * player, by PlayerId. */
+	void playout(Tree& tree, ChainReaction& game, std::vector<double>& scores);
+
+	/* Picks a move for the current player by the playout policy */
+	int playoutMove(Tree& tree, ChainReaction& game);
+
+	/* Returns the next number of the tree's random number generator */
+	static uint64_t nextRandom(Tree& tree);
+
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*	OpeningBook.cpp
+ *
+ *	Maps opening books into memory and looks positions up in them. See
+ *	OpeningBook.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "OpeningBook.h"
+
+/* Marks a file as a book, and the version of its layout */
+static const char BOOK_MAGIC[8] = { 'C', 'R', 'B', 'O', 'O', 'K', '\0', '\0' };
+static const uint32_t BOOK_VERSION = 1;
+
+static bool hashLess(const OpeningBook::Entry& a, const OpeningBook::Entry& b) {
+	return a.hash < b.hash;
+}
+
+OpeningBook::OpeningBook() : mapping(nullptr), mappingSize(0), entries(nullptr),
+							 numEntries(0), numRows(0), numCols(0), numPlayers(0) {}
+
+OpeningBook::~OpeningBook() {
+	close();
+}
+
+/* The header is checked against the size of the file before any entry is
+ * touched, so a truncated or foreign file is turned down rather than read
+ * past its end */
+bool OpeningBook::open(const std::string& path) {
+	close();
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || (std::size_t)status.st_size < sizeof(Header)) {
+		::close(file);
+		return false;
+	}
+	std::size_t length = status.st_size;
+	void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (data == MAP_FAILED)
+		return false;
+
+	const Header* header = static_cast<const Header*>(data);
+	if (memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) != 0
+		|| header->version != BOOK_VERSION || header->entrySize != sizeof(Entry)
+		|| header->entries != (length - sizeof(Header)) / sizeof(Entry)
+		|| (length - sizeof(Header)) % sizeof(Entry) != 0) {
+		munmap(data, length);
+		return false;
+	}
+	mapping = data;
+	mappingSize = length;
+	entries = reinterpret_cast<const Entry*>(static_cast<const char*>(data) + sizeof(Header));
+	numEntries = header->entries;
+	numRows = header->rows;
+	numCols = header->cols;
+	numPlayers = header->players;
+	return true;
+}
+
+void OpeningBook::close() {
+	if (mapping != nullptr)
+		munmap(mapping, mappingSize);
+	mapping = nullptr;
+	mappingSize = 0;
+	entries = nullptr;
+	numEntries = 0;
+	numRows = numCols = numPlayers = 0;
+}
+
+bool OpeningBook::matches(int rows, int cols, int players) const {
+	return numEntries > 0 && rows == numRows && cols == numCols && players == numPlayers;
+}
+
+bool OpeningBook::probe(uint64_t hash, Entry& entry) const {
+	Entry key;
+	key.hash = hash;
+	const Entry* end = entries + numEntries;
+	const Entry* found = std::lower_bound(entries, end, key, hashLess);
+	if (found == end || found->hash != hash)
+		return false;
+	entry = *found;
+	return true;
+}
+
+/* The sort is stable, so that of the entries for a position, the one kept is
+ * the first one given */
+bool OpeningBook::write(const std::string& path, int rows, int cols, int players,
+						std::vector<Entry> entries) {
+	std::stable_sort(entries.begin(), entries.end(), hashLess);
+	entries.erase(std::unique(entries.begin(), entries.end(),
+							  [](const Entry& a, const Entry& b) { return a.hash == b.hash; }),
+				  entries.end());
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+	header.version = BOOK_VERSION;
+	header.entrySize = sizeof(Entry);
+	header.rows = rows;
+	header.cols = cols;
+	header.players = players;
+	header.entries = entries.size();
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(entries.data(), sizeof(Entry), entries.size(), file) == entries.size();
+	return fclose(file) == 0 && written;
+}
@@ -0,0 +1,101 @@
+/*	OpeningBook.h
+ *
+ *	An opening book: the moves to play in positions near the start of a game, worked
+ *	out ahead of time (see BookBuilder.h), so that the AI doesn't have to search the
+ *	same openings again in every game. A book is for one size of board and number of
+ *	players, since the positions are known by their Zobrist hash (see Zobrist.h).
+ *
+ *	A book file is a header followed by an array of entries sorted by hash, exactly
+ *	as they are laid out in memory (in the byte order of the machine that wrote it).
+ *	The file is mapped into memory rather than read, so opening a book doesn't parse
+ *	or copy anything, and a position is looked up by binary search on the mapping.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _OPENINGBOOK_H_
+#define _OPENINGBOOK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class OpeningBook {
+public:
+
+	/* Move to play in a position, as the index of its cell, with the score and
+	 * depth of the search that chose it */
+	struct Entry {
+		uint64_t hash;
+		int32_t score;
+		uint16_t move;
+		uint16_t depth;
+	};
+
+	/* Constructor creates a book with no entries, until one is opened */
+	OpeningBook();
+
+	/* Destructor unmaps the file */
+	~OpeningBook();
+
+	OpeningBook(const OpeningBook&) = delete;
+	OpeningBook& operator =(const OpeningBook&) = delete;
+
+	/* Maps the given book file into memory, closing any book already open.
+	 * Returns false if the file can't be mapped, or isn't a valid book. */
+	bool open(const std::string& path);
+
+	/* Unmaps the file, leaving the book empty */
+	void close();
+
+	/* Returns whether the book is for games of the given size and number of
+	 * players */
+	bool matches(int rows, int cols, int players) const;
+
+	/* Looks up the position with the given hash. Returns true and fills in
+	 * the entry if it is in the book. */
+	bool probe(uint64_t hash, Entry& entry) const;
+
+	/* Number of positions in the book */
+	std::size_t size() const { return numEntries; }
+
+	/* Size of board, and number of players, the book is for */
+	int rows() const { return numRows; }
+	int cols() const { return numCols; }
+	int players() const { return numPlayers; }
+
+	/* Writes a book file with the given entries, which are sorted first.
+	 * Where several entries have the same hash, only the first is kept.
+	 * Returns false if the file couldn't be written. */
+	static bool write(const std::string& path, int rows, int cols, int players,
+					  std::vector<Entry> entries);
+
+private:
+
+	/* Header at the start of a book file */
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t entrySize;
+		uint16_t rows;
+		uint16_t cols;
+		uint32_t players;
+		uint64_t entries;
+	};
+
+	/* Mapping of the file, if one is open */
+	void* mapping;
+	std::size_t mappingSize;
+
+	/* Entries, which follow the header in the mapping */
+	const Entry* entries;
+	std::size_t numEntries;
+
+	int numRows;
+	int numCols;
+	int numPlayers;
+
+};
+
+#endif
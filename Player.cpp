@@ -25,6 +25,11 @@ Color::Modifier Player::color() const {
 	return colorModifier;
 }
 
+/* Human players are asked for their moves */
+bool Player::chooseMove(ChainReaction&, int&, int&) {
+	return false;
+}
+
 /* Sends message to given game to try and place a ball at the given
  * location. Will return whether the move was valid and successful. */
 bool Player::move(int row, int col, ChainReaction& game) {
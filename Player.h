@@ -27,6 +27,15 @@ public:
 	/* Constructor takes the player's name */
 	Player(const std::string& name);
 
+	/* Destructor is virtual, since players are deleted through Player pointers
+	 * whatever their actual type */
+	virtual ~Player() {}
+
+	/* Chooses a move for the player in the given game, storing it in the given
+	 * row and column. Returns false if the player doesn't choose their own moves
+	 * (a human player, who must be asked for them). */
+	virtual bool chooseMove(ChainReaction& game, int& row, int& col);
+
 	/* Changes the number of balls belonging to the player */
 	//void changeNumberOfBalls(int change);
 
@@ -0,0 +1,252 @@
+/*	Snapshot.cpp
+ *
+ *	Packs games into snapshots and restores them. See Snapshot.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "ChainReaction.h"
+#include "Snapshot.h"
+
+/* Marks a snapshot, and the version of its layout */
+static const char SNAPSHOT_MAGIC[8] = { 'C', 'R', 'S', 'N', 'A', 'P', '\0', '\0' };
+static const uint32_t SNAPSHOT_VERSION = 2;
+
+/* Most balls a cell of a snapshot can hold, and the shift and number of
+ * bits of its owner */
+static const int MAX_CELL_BALLS = 15;
+static const int OWNER_SHIFT = 4;
+static const int OWNER_BITS = 8 - OWNER_SHIFT;
+
+static_assert(MAX_PLAYERS < (1 << OWNER_BITS), "an owner's id must fit in a cell");
+static_assert(sizeof(int) == sizeof(int32_t), "players' data is copied as it is");
+
+/* Cells are unpacked eight at a time, as the bytes of a word */
+static const int WORD_CELLS = sizeof(uint64_t);
+static const uint64_t LOW_BITS = 0x0101010101010101ULL;
+static const uint64_t LOW_NIBBLES = 0x0f0f0f0f0f0f0f0fULL;
+static const uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+/* Reads the given number of cells (at most eight) into a word, with any
+ * cells past them left empty, and writes them back out. Whole words are
+ * copied with a fixed size, which compiles to a single move. */
+static inline uint64_t loadCells(const uint8_t* cells, int count) {
+	uint64_t word = 0;
+	if (count == WORD_CELLS)
+		memcpy(&word, cells, WORD_CELLS);
+	else
+		memcpy(&word, cells, count);
+	return word;
+}
+
+static inline void storeCells(uint8_t* cells, uint64_t word, int count) {
+	if (count == WORD_CELLS)
+		memcpy(cells, &word, WORD_CELLS);
+	else
+		memcpy(cells, &word, count);
+}
+
+/* Gathers the lowest bit of each byte of a word into a byte, with the bit
+ * of the first byte lowest */
+static inline uint64_t gatherBits(uint64_t word) {
+	return ((word & LOW_BITS) * 0x0102040810204080ULL) >> 56;
+}
+
+/* Shape and capacity rule of the board of a game, which for a board made
+ * without a topology is the plain grid */
+static void variantOf(const Board& board, uint8_t& shape, uint8_t& rule) {
+	const Topology* topology = board.topology();
+	shape = topology ? topology->shape() : GRID_SHAPE;
+	rule = topology ? topology->rule() : NEIGHBOUR_CAPACITY;
+}
+
+/* The ball counts follow the header, the evaluation terms follow them, and
+ * the cells come last */
+std::size_t Snapshot::size(int rows, int cols, int players) {
+	return sizeof(Header) + (players + 1) * (1 + ChainReaction::NUM_EVAL_TERMS) * sizeof(int32_t)
+		+ rows * cols;
+}
+
+bool Snapshot::save(const ChainReaction& game, std::vector<uint8_t>& data) {
+	const Board& board = game.board;
+	for (int cell = 0; cell < board.size(); ++cell) {
+		if (board.balls(cell) > MAX_CELL_BALLS)
+			return false;
+	}
+	int players = game.players.size();
+	data.assign(size(board.rows(), board.cols(), players), 0);
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.version = SNAPSHOT_VERSION;
+	header.size = data.size();
+	header.boardKey = game.boardKey;
+	header.rows = board.rows();
+	header.cols = board.cols();
+	header.totalBalls = game.totalBalls;
+	header.players = players;
+	header.current = game.current;
+	header.aliveMask = game.aliveMask;
+	header.movedMask = game.movedMask;
+	header.winner = game.playerId(game.winner);
+	variantOf(board, header.shape, header.rule);
+
+	uint8_t* counts = data.data() + sizeof(Header);
+	std::size_t countBytes = (players + 1) * sizeof(int32_t);
+	memcpy(counts, game.ballCounts.data(), countBytes);
+	uint8_t* terms = counts + countBytes;
+	std::size_t termBytes = game.evalTerms.size() * sizeof(int32_t);
+	memcpy(terms, game.evalTerms.data(), termBytes);
+	uint8_t* cells = terms + termBytes;
+	for (int cell = 0; cell < board.size(); ++cell) {
+		cells[cell] = (board.owner(cell) << OWNER_SHIFT) | board.balls(cell);
+	}
+
+	memcpy(data.data(), &header, sizeof(header));
+	header.checksum = checksum(data.data() + offsetof(Header, boardKey),
+							   data.size() - offsetof(Header, boardKey));
+	memcpy(data.data(), &header, sizeof(header));
+	return true;
+}
+
+/* Everything is checked before the game is touched, the owners of the cells
+ * eight at a time: adding (0x7f - players) to an owner's id sets the top bit
+ * of its byte only if the id is above the number of players.
+ * The cells are then unpacked into the board's planes eight at a time, and
+ * the masks of owned cells rebuilt from the bits of the owners' ids: each bit
+ * of the ids is gathered into a word with a bit for each cell (a "bit plane"),
+ * and the mask of each owner is the cells whose bits match those of its id.
+ * Only as many bits as the highest id has are needed, as no owner is above
+ * it. */
+bool Snapshot::restore(const uint8_t* data, std::size_t size, ChainReaction& game) {
+	if (size < sizeof(Header))
+		return false;
+	Header header;
+	memcpy(&header, data, sizeof(header));
+	int players = game.players.size();
+	Board& board = game.board;
+	uint8_t shape, rule;
+	variantOf(board, shape, rule);
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+		|| header.version != SNAPSHOT_VERSION
+		|| header.size != size
+		|| size != Snapshot::size(board.rows(), board.cols(), players)
+		|| header.rows != board.rows() || header.cols != board.cols()
+		|| header.shape != shape || header.rule != rule
+		|| header.players != players
+		|| header.current > players || header.winner > players
+		|| (header.aliveMask >> players) != 0 || (header.movedMask >> players) != 0
+		|| header.checksum != checksum(data + offsetof(Header, boardKey),
+									   size - offsetof(Header, boardKey)))
+		return false;
+
+	const uint8_t* counts = data + sizeof(Header);
+	std::size_t countBytes = (players + 1) * sizeof(int32_t);
+	const uint8_t* terms = counts + countBytes;
+	std::size_t termBytes = game.evalTerms.size() * sizeof(int32_t);
+	const uint8_t* cells = terms + termBytes;
+	uint64_t overflow = 0;
+	for (int cell = 0; cell < board.size(); cell += WORD_CELLS) {
+		uint64_t packed = loadCells(cells + cell, std::min(WORD_CELLS, board.size() - cell));
+		overflow |= ((packed >> OWNER_SHIFT) & LOW_NIBBLES) + (0x7f - players) * LOW_BITS;
+	}
+	if ((overflow & HIGH_BITS) != 0)
+		return false;
+
+	uint8_t* balls = &board.balls(0);
+	PlayerId* owners = &board.owner(0);
+	int ownerBits = (players == 0) ? 0 : 32 - __builtin_clz(players);
+	for (int word = 0; word < game.maskWords; ++word) {
+		uint64_t planes[OWNER_BITS] = {};
+		int first = 64 * word;
+		int end = std::min(board.size(), first + 64);
+		for (int cell = first; cell < end; cell += WORD_CELLS) {
+			int count = std::min(WORD_CELLS, end - cell);
+			uint64_t packed = loadCells(cells + cell, count);
+			uint64_t ballBytes = packed & LOW_NIBBLES;
+			uint64_t ownerBytes = (packed >> OWNER_SHIFT) & LOW_NIBBLES;
+			storeCells(balls + cell, ballBytes, count);
+			storeCells(owners + cell, ownerBytes, count);
+			for (int bit = 0; bit < ownerBits; ++bit) {
+				planes[bit] |= gatherBits(ownerBytes >> bit) << (cell - first);
+			}
+		}
+		uint64_t onBoard = (end - first == 64) ? ~uint64_t(0) : (uint64_t(1) << (end - first)) - 1;
+		for (int owner = 0; owner <= players; ++owner) {
+			uint64_t mask = onBoard;
+			for (int bit = 0; bit < ownerBits; ++bit) {
+				mask &= ((owner >> bit) & 1) ? planes[bit] : ~planes[bit];
+			}
+			game.ownedCells[owner * game.maskWords + word] = mask;
+		}
+	}
+	memcpy(game.ballCounts.data(), counts, countBytes);
+	memcpy(game.evalTerms.data(), terms, termBytes);
+
+	game.boardKey = header.boardKey;
+	game.totalBalls = header.totalBalls;
+	game.current = header.current;
+	game.aliveMask = header.aliveMask;
+	game.movedMask = header.movedMask;
+	game.winner = game.playerFromId(header.winner);
+	game.cascade = ChainReaction::CascadeStats();
+	game.cellJournal.clear();
+	game.evalJournal.clear();
+	game.moveJournal.clear();
+	return true;
+}
+
+bool Snapshot::write(const std::string& path, const ChainReaction& game) {
+	std::vector<uint8_t> data;
+	if (!save(game, data))
+		return false;
+	std::string temporary = path + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	written = (fclose(file) == 0) && written;
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool Snapshot::read(const std::string& path, ChainReaction& game) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+	std::vector<uint8_t> data(size(game.rows, game.cols, game.players.size()));
+	std::size_t length = fread(data.data(), 1, data.size(), file);
+	bool longer = fgetc(file) != EOF;
+	fclose(file);
+	return !longer && restore(data.data(), length, game);
+}
+
+/* Each word is folded into the sum and mixed with a multiply and a shift,
+ * which is quick enough that checking a snapshot costs about as much as
+ * copying it. Any bytes left over are folded in as a last, shorter word. */
+uint64_t Snapshot::checksum(const uint8_t* data, std::size_t size) {
+	const uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+	uint64_t sum = size * MULTIPLIER;
+	std::size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		sum = ((sum ^ word) * MULTIPLIER);
+		sum ^= sum >> 29;
+	}
+	if (i < size) {
+		uint64_t word = 0;
+		memcpy(&word, data + i, size - i);
+		sum = ((sum ^ word) * MULTIPLIER);
+		sum ^= sum >> 29;
+	}
+	return sum ^ (sum >> 32);
+}
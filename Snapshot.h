@@ -0,0 +1,94 @@
+/*	Snapshot.h
+ *
+ *	A compact binary snapshot of a ChainReaction position, for saving a game to recover
+ *	it later, for handing positions to other processes, and as a key for caches of
+ *	positions. A snapshot holds the board, one byte to a cell (the owner's id in the
+ *	high four bits and the number of balls in the low four), the shape and capacity rule
+ *	of the board (see Topology.h), and the state of the game outside the board: whose
+ *	turn it is, who is still in the game and who has moved, the winner, and the number
+ *	of moves played so far.
+ *
+ *	Along with these, a snapshot keeps the state the game derives from the board (the
+ *	Zobrist hash of the board, and each player's ball count and evaluation terms), so
+ *	that restoring one is a single pass over the cells, eight at a time, with no
+ *	neighbours looked at, rather than a replay of how the game got there. The snapshot
+ *	is restored straight from the caller's buffer, without being parsed or copied
+ *	anywhere else first.
+ *
+ *	A snapshot starts with a header, which includes a checksum of everything after it,
+ *	so that a snapshot cut short or corrupted is refused rather than restored. As with
+ *	opening books, numbers are in the byte order of the machine that wrote them.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ChainReaction;
+
+class Snapshot {
+public:
+
+	/* Returns the size in bytes of the snapshot of a game of the given size
+	 * and number of players */
+	static std::size_t size(int rows, int cols, int players);
+
+	/* Writes the snapshot of the given game into the given buffer, resizing it
+	 * to fit. Returns false if the game can't be packed, which is only the case
+	 * for a cell holding more balls than fit in four bits (as the cell of a
+	 * 1x1 board, which never explodes, may). */
+	static bool save(const ChainReaction& game, std::vector<uint8_t>& data);
+
+	/* Restores the given game to the position of the snapshot of the given
+	 * size. The game must be of the same size, shape and capacity rule, and
+	 * have the same number of players as the one the snapshot was taken of.
+	 * Moves made with makeMove() before the snapshot was restored can no longer
+	 * be taken back. Returns false, leaving the game as it was, if the snapshot
+	 * is not valid or is for another size or variant of game. */
+	static bool restore(const uint8_t* data, std::size_t size, ChainReaction& game);
+
+	/* Writes the snapshot of the given game to the given path. The file is
+	 * written under a temporary name first and then renamed, so that a crash
+	 * while writing never leaves a partly written snapshot at the path.
+	 * Returns false if the game can't be packed or the file can't be written. */
+	static bool write(const std::string& path, const ChainReaction& game);
+
+	/* Restores the given game from the snapshot in the given file, as
+	 * restore() does */
+	static bool read(const std::string& path, ChainReaction& game);
+
+private:
+
+	/* Header at the start of a snapshot. The checksum covers everything after
+	 * it, from the hash of the board to the last cell. */
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t size;
+		uint64_t checksum;
+		uint64_t boardKey;
+		uint16_t rows;
+		uint16_t cols;
+		uint32_t totalBalls;
+		uint8_t players;
+		uint8_t current;
+		uint8_t aliveMask;
+		uint8_t movedMask;
+		uint8_t winner;
+		uint8_t shape;
+		uint8_t rule;
+		uint8_t padding;
+	};
+
+	/* Checksum of the given bytes, taken eight at a time */
+	static uint64_t checksum(const uint8_t* data, std::size_t size);
+
+};
+
+#endif
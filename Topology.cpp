@@ -0,0 +1,108 @@
+/*	Topology.cpp
+ *
+ *	Works out the neighbours and capacities of the cells of a board. See Topology.h
+ *	for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+
+#include "Topology.h"
+
+/* Offsets, as (row, column), of the neighbours of a cell in each shape. The
+ * grid and the torus list them above, left, below, then right, as
+ * Board::neighbours() does. Cells of a hex grid have different offsets on
+ * even rows and on odd rows, which are shifted right of the rows around them. */
+static const int GRID_OFFSETS[][2] = { { -1, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 } };
+static const int DIAGONAL_OFFSETS[][2] = { { -1, -1 }, { -1, 0 }, { -1, 1 }, { 0, -1 },
+										   { 0, 1 }, { 1, -1 }, { 1, 0 }, { 1, 1 } };
+static const int EVEN_HEX_OFFSETS[][2] = { { -1, -1 }, { -1, 0 }, { 0, -1 },
+										   { 0, 1 }, { 1, -1 }, { 1, 0 } };
+static const int ODD_HEX_OFFSETS[][2] = { { -1, 0 }, { -1, 1 }, { 0, -1 },
+										  { 0, 1 }, { 1, 0 }, { 1, 1 } };
+
+/* Names of the shapes, by Shape */
+static const char* const SHAPE_NAMES[] = { "grid", "torus", "hex", "diagonal" };
+
+/* The neighbours are appended cell by cell, so that each cell's offset is
+ * the length of the list before it. Under fixed capacity, cells with no
+ * neighbours (on a 1x1 board) are still left without a capacity. */
+Topology::Topology(int rows, int cols, Shape shape, CapacityRule rule) :
+				   numRows(rows), numCols(cols), kind(shape), capacityRule(rule),
+				   offsets(rows * cols + 1, 0), capacities(rows * cols, 0) {
+	int maxDegree = 0;
+	for (int row = 0; row < rows; ++row) {
+		for (int col = 0; col < cols; ++col) {
+			int cell = row * cols + col;
+			int next[MAX_DEGREE];
+			int count = findNeighbours(row, col, next);
+			neighbourList.insert(neighbourList.end(), next, next + count);
+			offsets[cell + 1] = neighbourList.size();
+			maxDegree = std::max(maxDegree, count);
+		}
+	}
+	for (int cell = 0; cell < size(); ++cell) {
+		int count = degree(cell);
+		capacities[cell] = (rule == FIXED_CAPACITY && count > 0) ? maxDegree : count;
+	}
+}
+
+/* Offsets that fall off the board are dropped, except on a torus, where they
+ * wrap around to the other side. On a torus too narrow for that to reach a
+ * different cell each way, a cell is not its own neighbour, nor is any cell
+ * listed twice. */
+int Topology::findNeighbours(int row, int col, int* out) const {
+	const int (*cellOffsets)[2] = GRID_OFFSETS;
+	int numOffsets = 4;
+	if (kind == DIAGONAL_SHAPE) {
+		cellOffsets = DIAGONAL_OFFSETS;
+		numOffsets = 8;
+	} else if (kind == HEX_SHAPE) {
+		cellOffsets = (row % 2 == 0) ? EVEN_HEX_OFFSETS : ODD_HEX_OFFSETS;
+		numOffsets = 6;
+	}
+
+	int cell = row * numCols + col;
+	int count = 0;
+	for (int i = 0; i < numOffsets; ++i) {
+		int nextRow = row + cellOffsets[i][0];
+		int nextCol = col + cellOffsets[i][1];
+		if (kind == TORUS_SHAPE) {
+			nextRow = (nextRow + numRows) % numRows;
+			nextCol = (nextCol + numCols) % numCols;
+		} else if (nextRow < 0 || nextRow >= numRows || nextCol < 0 || nextCol >= numCols) {
+			continue;
+		}
+		int next = nextRow * numCols + nextCol;
+		if (next != cell && std::find(out, out + count, next) == out + count)
+			out[count++] = next;
+	}
+	return count;
+}
+
+std::string Topology::name() const {
+	std::string variant = SHAPE_NAMES[kind];
+	if (capacityRule == FIXED_CAPACITY)
+		variant += ":fixed";
+	return variant;
+}
+
+bool Topology::parse(const std::string& variant, Shape& shape, CapacityRule& rule) {
+	std::string shapeName = variant;
+	rule = NEIGHBOUR_CAPACITY;
+	size_t colon = variant.find(':');
+	if (colon != std::string::npos) {
+		if (variant.substr(colon + 1) != "fixed")
+			return false;
+		shapeName = variant.substr(0, colon);
+		rule = FIXED_CAPACITY;
+	}
+	for (int i = GRID_SHAPE; i <= DIAGONAL_SHAPE; ++i) {
+		if (shapeName == SHAPE_NAMES[i]) {
+			shape = Shape(i);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,97 @@
+/*	Topology.h
+ *
+ *	The shape of a board other than the plain grid: which cells are neighbours, and
+ *	how many balls each cell holds before it explodes. A board may be a torus (a grid
+ *	whose edges wrap around to the opposite edge), a hex grid (with every odd row
+ *	shifted half a cell to the right, so that each cell has six neighbours), or a grid
+ *	with diagonal neighbours (eight to a cell), as well as the plain grid.
+ *
+ *	Capacity follows one of two rules. Under the standard rule, a cell's capacity is
+ *	its number of neighbours, and an exploding cell is left empty. Under fixed
+ *	capacity, every cell has the capacity of the cells with the most neighbours, and
+ *	an exploding cell gives one ball to each of its neighbours and keeps the rest,
+ *	so that no balls are lost off the edges of the board.
+ *
+ *	The neighbours of every cell are worked out once, when the topology is made, and
+ *	kept in compressed sparse row form: one flat array of the neighbours of every
+ *	cell, one cell after another, and an array of where each cell's neighbours start
+ *	in it. Along with the table of capacities, that is all that playing a move needs
+ *	to know of the board's shape (see CsrLayout in Board.h).
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _TOPOLOGY_H_
+#define _TOPOLOGY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* How the cells of a board are connected */
+enum Shape { GRID_SHAPE, TORUS_SHAPE, HEX_SHAPE, DIAGONAL_SHAPE };
+
+/* How the capacity of a cell is set */
+enum CapacityRule { NEIGHBOUR_CAPACITY, FIXED_CAPACITY };
+
+/* Most neighbours a cell can have, in any shape */
+const int MAX_DEGREE = 8;
+
+class Topology {
+public:
+
+	/* Constructor works out the neighbours and capacity of every cell of a
+	 * board of the given dimensions, shape and rule */
+	Topology(int rows, int cols, Shape shape = GRID_SHAPE,
+			 CapacityRule rule = NEIGHBOUR_CAPACITY);
+
+	int rows() const { return numRows; }
+	int cols() const { return numCols; }
+	int size() const { return numRows * numCols; }
+	Shape shape() const { return kind; }
+	CapacityRule rule() const { return capacityRule; }
+
+	/* Returns whether this is the plain grid under the standard rule, which a
+	 * board is laid out as without a topology */
+	bool isPlainGrid() const {
+		return (kind == GRID_SHAPE && capacityRule == NEIGHBOUR_CAPACITY);
+	}
+
+	/* Number of neighbours of a cell, and the first of them. The rest follow
+	 * it in the flat array of neighbours. */
+	int degree(int cell) const { return offsets[cell + 1] - offsets[cell]; }
+	const int* neighbours(int cell) const { return &neighbourList[offsets[cell]]; }
+
+	/* Number of balls at which a cell explodes (zero for a cell that has no
+	 * neighbours, and so never explodes) */
+	uint8_t capacity(int cell) const { return capacities[cell]; }
+
+	/* Returns the name of the topology's variant, as parse() reads it */
+	std::string name() const;
+
+	/* Reads a variant, given as the name of a shape ("grid", "torus", "hex"
+	 * or "diagonal"), followed by ":fixed" for fixed capacity. Returns false
+	 * if the variant isn't one of these. */
+	static bool parse(const std::string& variant, Shape& shape, CapacityRule& rule);
+
+private:
+
+	int numRows;
+	int numCols;
+	Shape kind;
+	CapacityRule capacityRule;
+
+	/* Where the neighbours of each cell start in neighbourList, with one more
+	 * entry at the end for where the last cell's neighbours end */
+	std::vector<int> offsets;
+	std::vector<int> neighbourList;
+	std::vector<uint8_t> capacities;
+
+	/* Writes the neighbours of the cell at the given coordinates into the
+	 * given array (which must hold MAX_DEGREE entries), and returns how many
+	 * there are */
+	int findNeighbours(int row, int col, int* out) const;
+
+};
+
+#endif
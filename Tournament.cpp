@@ -0,0 +1,230 @@
+/*	Tournament.cpp
+ *
+ *	Implements headless tournaments between computer players. See Tournament.h
+ *	for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "ChainReaction.h"
+#include "MCTSPlayer.h"
+#include "Tournament.h"
+
+/* z-score of the 95% confidence interval */
+const double Z_95 = 1.96;
+
+/* Creates a player using the given engine, searching on a single thread */
+static Player* createPlayer(const EngineConfig& engine, const std::string& name,
+							const TournamentConfig& config) {
+	if (engine.type == MCTS_ENGINE) {
+		MCTSPlayer* player = new MCTSPlayer(name);
+		player->setBudget(engine.budget);
+		return player;
+	}
+	AIPlayer* player = new AIPlayer(name);
+	player->setHashSize(config.hashMegabytes);
+	player->setBudget(engine.budget);
+	for (const auto& book : config.books) {
+		player->addBook(book);
+	}
+	for (const auto& endgame : config.endgames) {
+		player->addEndgameTable(endgame);
+	}
+	return player;
+}
+
+/* Plays one game of the tournament, with the engines rotated into their seats
+ * for that game, and writes it to the journal. Returns the index of the
+ * winning engine, or -1 if no valid move could be found, and counts the moves
+ * played. */
+static int playGame(const TournamentConfig& config, int gameNumber, uint64_t& moves) {
+	int numEngines = config.engines.size();
+	std::vector<Player*> players(numEngines);
+	for (int i = 0; i < numEngines; ++i) {
+		int seat = (i + gameNumber) % numEngines;
+		players[seat] = createPlayer(config.engines[i], config.engines[i].name(), config);
+	}
+	ChainReaction game = config.topology ? ChainReaction(config.topology, players)
+										 : ChainReaction(config.rows, config.cols, players);
+	GameRecord record(game);
+	int winner = -1;
+	moves = 0;
+	while (!game.gameOver()) {
+		Player* player = game.currentPlayer();
+		int row, col;
+		if (!player->chooseMove(game, row, col) || !player->move(row, col, game))
+			break;
+		if (config.journal)
+			record.addMove(game, row, col);
+		++moves;
+	}
+	if (config.journal) {
+		record.finish(game);
+		config.journal->write(record);
+	}
+	for (int i = 0; i < numEngines; ++i) {
+		if (game.gameOver() && players[(i + gameNumber) % numEngines] == game.getWinner())
+			winner = i;
+	}
+	for (Player* player : players) {
+		delete player;
+	}
+	return winner;
+}
+
+/* Each worker takes the number of the next game from a shared counter,
+ * until every game has been handed out, and adds its results to the
+ * totals under a lock */
+TournamentResult runTournament(const TournamentConfig& config, std::ostream* progress) {
+	auto start = std::chrono::steady_clock::now();
+	TournamentResult result;
+	result.wins.assign(config.engines.size(), 0);
+	std::atomic<int> nextGame(0);
+	std::mutex resultLock;
+
+	auto work = [&]() {
+		while (true) {
+			int gameNumber = nextGame++;
+			if (gameNumber >= config.games)
+				break;
+			uint64_t moves;
+			int winner = playGame(config, gameNumber, moves);
+			std::lock_guard<std::mutex> lock(resultLock);
+			++result.games;
+			result.totalMoves += moves;
+			if (winner >= 0)
+				++result.wins[winner];
+			if (progress != nullptr) {
+				*progress << "Game " << gameNumber + 1 << ": ";
+				if (winner >= 0)
+					*progress << "#" << winner + 1 << " " << config.engines[winner].name();
+				else
+					*progress << "no winner";
+				*progress << " in " << moves << " moves" << std::endl;
+			}
+		}
+	};
+
+	int workers = (config.workers < 1) ? 1 : config.workers;
+	std::vector<std::thread> threads;
+	for (int i = 1; i < workers; ++i) {
+		threads.emplace_back(work);
+	}
+	work();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	result.milliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+/* One line per engine, then the totals */
+void printTournament(std::ostream& out, const TournamentConfig& config,
+					 const TournamentResult& result) {
+	char line[128];
+	std::string variant = (config.topology && !config.topology->isPlainGrid())
+						  ? " " + config.topology->name() : "";
+	snprintf(line, sizeof(line), "%d games on a %dx%d%s board, %d workers",
+			 result.games, config.rows, config.cols, variant.c_str(), config.workers);
+	out << line << std::endl;
+	snprintf(line, sizeof(line), "%-4s %-28s %6s %9s %17s",
+			 "#", "engine", "wins", "win rate", "95% interval");
+	out << line << std::endl;
+	for (size_t i = 0; i < config.engines.size(); ++i) {
+		double low, high;
+		result.confidenceInterval(i, low, high);
+		snprintf(line, sizeof(line), "%-4d %-28s %6d %8.1f%% %7.1f%% - %5.1f%%",
+				 (int)i + 1, config.engines[i].name().c_str(), result.wins[i],
+				 100 * result.winRate(i), 100 * low, 100 * high);
+		out << line << std::endl;
+	}
+	snprintf(line, sizeof(line), "Average game length: %.1f moves", result.averageLength());
+	out << line << std::endl;
+	snprintf(line, sizeof(line), "Games per second: %.2f", result.gamesPerSecond());
+	out << line << std::endl;
+}
+
+/* Splits the description on colons, and reads the budget from the fields
+ * after the type. Missing fields keep the default budget. */
+bool parseEngine(const std::string& description, EngineConfig& engine) {
+	std::vector<std::string> fields;
+	std::istringstream stream(description);
+	std::string field;
+	while (std::getline(stream, field, ':')) {
+		fields.push_back(field);
+	}
+	if (fields.empty() || fields.size() > 4)
+		return false;
+	if (fields[0] == "alphabeta" || fields[0] == "ab")
+		engine.type = ALPHA_BETA_ENGINE;
+	else if (fields[0] == "mcts")
+		engine.type = MCTS_ENGINE;
+	else
+		return false;
+	engine.budget = SearchBudget();
+	for (size_t i = 1; i < fields.size(); ++i) {
+		char* end;
+		long long value = strtoll(fields[i].c_str(), &end, 10);
+		if (fields[i].empty() || *end != '\0' || value < 0)
+			return false;
+		if (i == 1)
+			engine.budget.milliseconds = value;
+		else if (i == 2)
+			engine.budget.nodes = value;
+		else
+			engine.budget.depth = value;
+	}
+	return true;
+}
+
+/* Only the parts of the budget that limit the search are named */
+std::string EngineConfig::name() const {
+	std::ostringstream name;
+	name << ((type == MCTS_ENGINE) ? "mcts" : "alphabeta");
+	if (budget.milliseconds > 0)
+		name << ":" << budget.milliseconds << "ms";
+	if (budget.nodes > 0)
+		name << ":" << budget.nodes << ((type == MCTS_ENGINE) ? " playouts" : " nodes");
+	if (type == ALPHA_BETA_ENGINE && budget.depth != DEPTH)
+		name << ":depth " << budget.depth;
+	return name.str();
+}
+
+double TournamentResult::winRate(int engine) const {
+	return (games > 0) ? (double)wins[engine] / games : 0;
+}
+
+void TournamentResult::confidenceInterval(int engine, double& low, double& high) const {
+	if (games == 0) {
+		low = 0;
+		high = 1;
+		return;
+	}
+	double p = winRate(engine);
+	double z2 = Z_95 * Z_95;
+	double denominator = 1 + z2 / games;
+	double centre = (p + z2 / (2 * games)) / denominator;
+	double spread = Z_95 * std::sqrt(p * (1 - p) / games + z2 / (4.0 * games * games))
+					/ denominator;
+	low = std::max(0.0, centre - spread);
+	high = std::min(1.0, centre + spread);
+}
+
+double TournamentResult::averageLength() const {
+	return (games > 0) ? (double)totalMoves / games : 0;
+}
+
+double TournamentResult::gamesPerSecond() const {
+	return (milliseconds > 0) ? 1000 * games / milliseconds : 0;
+}
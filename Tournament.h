@@ -0,0 +1,108 @@
+/*	Tournament.h
+ *
+ *	This runs many games of ChainReaction between computer players without any
+ *	prompting, to compare engines (or the same engine with different settings).
+ *	Each player in the tournament is given as an engine -- alpha-beta or Monte Carlo
+ *	tree search -- and a budget for each of its moves. Games are played on a pool of
+ *	worker threads, each worker playing one game at a time with players of its own,
+ *	and taking the next game to play from a shared counter until all are played.
+ *
+ *	So that no engine profits from moving first, the seats are rotated from one game
+ *	to the next: in game g, the engine given at index i plays in seat (i + g) mod n.
+ *	Results are reported per engine, as its number of wins and its win rate, with a
+ *	95% confidence interval (the Wilson score interval), along with the average
+ *	length of the games and the number of games played per second. Every game may
+ *	also be written to a journal (see GameJournal.h).
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _TOURNAMENT_H_
+#define _TOURNAMENT_H_
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AIPlayer.h"
+#include "GameJournal.h"
+#include "Topology.h"
+
+/* Kind of search an engine uses to choose its moves */
+enum EngineType { ALPHA_BETA_ENGINE, MCTS_ENGINE };
+
+/* An engine taking part in a tournament, and the budget for each of its moves */
+struct EngineConfig {
+	EngineConfig(EngineType type = ALPHA_BETA_ENGINE,
+				 const SearchBudget& budget = SearchBudget())
+		: type(type), budget(budget) {}
+
+	/* Returns a name for the engine, made of its type and budget, such as
+	 * "alphabeta:100ms" */
+	std::string name() const;
+
+	EngineType type;
+	SearchBudget budget;
+};
+
+/* Settings of a tournament: the board to play on, the number of games, the
+ * number of worker threads, and the engines, one for each seat. Every engine
+ * searches on a single thread, since the games themselves run in parallel.
+ * Alpha-beta engines get a transposition table of the given size, and the
+ * opening books and endgame tables, if any. Games are written to the
+ * journal, if there is one. The board is the plain grid of the given size,
+ * unless a topology (of the same size) is given. */
+struct TournamentConfig {
+	TournamentConfig() : rows(5), cols(5), games(100), workers(1), hashMegabytes(4) {}
+
+	int rows;
+	int cols;
+	std::shared_ptr<const Topology> topology;
+	int games;
+	int workers;
+	int hashMegabytes;
+	std::vector<EngineConfig> engines;
+	std::vector<std::shared_ptr<const OpeningBook> > books;
+	std::vector<std::shared_ptr<const EndgameTable> > endgames;
+	std::shared_ptr<GameJournal> journal;
+};
+
+/* Results of a tournament, by the index of each engine in the configuration */
+struct TournamentResult {
+	TournamentResult() : games(0), totalMoves(0), milliseconds(0) {}
+
+	/* Returns the fraction of games won by the given engine */
+	double winRate(int engine) const;
+
+	/* Returns the bounds of the 95% confidence interval of the engine's win
+	 * rate, by the Wilson score interval */
+	void confidenceInterval(int engine, double& low, double& high) const;
+
+	/* Returns the average number of moves in a game */
+	double averageLength() const;
+
+	/* Returns the number of games played per second */
+	double gamesPerSecond() const;
+
+	std::vector<int> wins;
+	int games;
+	uint64_t totalMoves;
+	double milliseconds;
+};
+
+/* Plays the tournament, and returns its results. Reports each game as it
+ * finishes to the given stream, if one is given. */
+TournamentResult runTournament(const TournamentConfig& config,
+							   std::ostream* progress = nullptr);
+
+/* Prints a table of the results of the tournament */
+void printTournament(std::ostream& out, const TournamentConfig& config,
+					 const TournamentResult& result);
+
+/* Reads an engine from a description of the form type[:milliseconds[:nodes[:depth]]],
+ * where the type is "alphabeta" or "mcts". Returns false if it isn't valid. */
+bool parseEngine(const std::string& description, EngineConfig& engine);
+
+#endif
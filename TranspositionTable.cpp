@@ -0,0 +1,174 @@
+/*	TranspositionTable.cpp
+ *
+ *	Implements the transposition table for the AI's search. See
+ *	TranspositionTable.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <new>
+
+#include "EngineStats.h"
+#include "TranspositionTable.h"
+
+/* Layout of an entry's data word: the score takes the low 32 bits, then
+ * 16 bits for the move (offset by one so that -1 packs to zero), 8 for the
+ * depth, 2 for the bound and 6 for the generation. */
+static const int MOVE_SHIFT = 32;
+static const int DEPTH_SHIFT = 48;
+static const int BOUND_SHIFT = 56;
+static const int GENERATION_SHIFT = 58;
+static const int GENERATIONS = 64;
+
+/* Constructor allocates the table and clears it */
+TranspositionTable::TranspositionTable(size_t megabytes) : buckets(nullptr),
+														   numBuckets(0),
+														   generation(0),
+														   counters(1) {
+	resize(megabytes);
+}
+
+/* The number of buckets is rounded down to a power of two, so that a
+ * position's bucket can be found by masking its key. There is always at
+ * least one bucket. */
+void TranspositionTable::resize(size_t megabytes) {
+	size_t bytes = megabytes * 1024 * 1024;
+	numBuckets = 1;
+	while (2 * numBuckets * sizeof(Bucket) <= bytes) {
+		numBuckets *= 2;
+	}
+	memory.reset(new char[numBuckets * sizeof(Bucket) + CACHE_LINE]);
+	uintptr_t address = reinterpret_cast<uintptr_t>(memory.get());
+	address = (address + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+	buckets = reinterpret_cast<Bucket*>(address);
+	for (size_t i = 0; i < numBuckets; ++i) {
+		new (&buckets[i]) Bucket;
+	}
+	clear();
+}
+
+/* Zeroes every entry. An entry with a zero data word has no bound, and is
+ * thus empty. */
+void TranspositionTable::clear() {
+	for (size_t i = 0; i < numBuckets; ++i) {
+		for (int j = 0; j < BUCKET_SIZE; ++j) {
+			buckets[i].entries[j].key.store(0, std::memory_order_relaxed);
+			buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+		}
+	}
+	generation = 0;
+	counters.assign(counters.size(), Counters());
+}
+
+/* Replaces the counters with a set for each thread */
+void TranspositionTable::setThreads(int threads) {
+	counters.assign(threads, Counters());
+}
+
+/* Moves on to the next generation, which wraps around */
+void TranspositionTable::newSearch() {
+	generation = (generation + 1) % GENERATIONS;
+}
+
+/* Checks every entry in the position's bucket for its key */
+bool TranspositionTable::probe(uint64_t key, Result& result, int thread) {
+	Counters& count = counters[thread];
+	++count.probes;
+	STAT_ADD(ttProbes, 1);
+	Bucket& bucket = bucketFor(key);
+	for (int i = 0; i < BUCKET_SIZE; ++i) {
+		Entry& entry = bucket.entries[i];
+		uint64_t data = entry.data.load(std::memory_order_relaxed);
+		uint64_t entryKey = entry.key.load(std::memory_order_relaxed) ^ data;
+		if (entryKey == key && data != 0) {
+			++count.hits;
+			STAT_ADD(ttHits, 1);
+			result = unpack(data);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Stores over an entry for the same position if there is one. Otherwise
+ * replaces the entry from the oldest generation, breaking ties by the lowest
+ * depth. (An empty entry counts as the oldest and shallowest of all.) */
+void TranspositionTable::store(uint64_t key, int score, int move,
+							   int depth, Bound bound) {
+	Bucket& bucket = bucketFor(key);
+	Entry* replace = &bucket.entries[0];
+	int replaceWorth = 0;
+	for (int i = 0; i < BUCKET_SIZE; ++i) {
+		Entry& entry = bucket.entries[i];
+		uint64_t data = entry.data.load(std::memory_order_relaxed);
+		uint64_t entryKey = entry.key.load(std::memory_order_relaxed) ^ data;
+		if (entryKey == key || data == 0) {
+			replace = &entry;
+			break;
+		}
+		int age = (generation - generationOf(data) + GENERATIONS) % GENERATIONS;
+		int worth = unpack(data).depth - 8 * age;
+		if (i == 0 || worth < replaceWorth) {
+			replace = &entry;
+			replaceWorth = worth;
+		}
+	}
+	uint64_t data = pack(score, move, depth, bound, generation);
+	replace->key.store(key ^ data, std::memory_order_relaxed);
+	replace->data.store(data, std::memory_order_relaxed);
+}
+
+/* Sums the lookups of every thread */
+uint64_t TranspositionTable::probes() const {
+	uint64_t total = 0;
+	for (const Counters& count : counters) {
+		total += count.probes;
+	}
+	return total;
+}
+
+/* Sums the hits of every thread */
+uint64_t TranspositionTable::hits() const {
+	uint64_t total = 0;
+	for (const Counters& count : counters) {
+		total += count.hits;
+	}
+	return total;
+}
+
+/* Returns the size of the buckets in bytes */
+size_t TranspositionTable::size() const {
+	return numBuckets * sizeof(Bucket);
+}
+
+/* Returns hits over probes */
+double TranspositionTable::hitRate() const {
+	uint64_t lookups = probes();
+	if (lookups == 0)
+		return 0;
+	return (double)hits() / lookups;
+}
+
+/* ===== Private Functions =====*/
+
+uint64_t TranspositionTable::pack(int score, int move, int depth,
+								  Bound bound, int generation) {
+	return (uint64_t)(uint32_t)score
+		   | ((uint64_t)(uint16_t)(move + 1) << MOVE_SHIFT)
+		   | ((uint64_t)(uint8_t)depth << DEPTH_SHIFT)
+		   | ((uint64_t)bound << BOUND_SHIFT)
+		   | ((uint64_t)generation << GENERATION_SHIFT);
+}
+
+TranspositionTable::Result TranspositionTable::unpack(uint64_t data) {
+	Result result;
+	result.score = (int32_t)(uint32_t)data;
+	result.move = (int)(uint16_t)(data >> MOVE_SHIFT) - 1;
+	result.depth = (uint8_t)(data >> DEPTH_SHIFT);
+	result.bound = (Bound)((data >> BOUND_SHIFT) & 3);
+	return result;
+}
+
+int TranspositionTable::generationOf(uint64_t data) {
+	return (int)(data >> GENERATION_SHIFT);
+}
@@ -0,0 +1,132 @@
+/*	TranspositionTable.h
+ *
+ *	A fixed-size hash table of search results, keyed by the Zobrist hash of a
+ *	ChainReaction position. Since the same position is often reached through
+ *	different orders of moves, the AI may look up what it found the last time it
+ *	searched a position, rather than search it again.
+ *
+ *	Entries are grouped into buckets the size of a cache line, so a lookup touches
+ *	a single line of memory. A position may be stored in any entry of its bucket.
+ *	When the bucket is full, the entry replaced is the one left by the oldest search,
+ *	or among those the one searched to the least depth.
+ *
+ *	The table may be shared by several threads searching at once, without locks.
+ *	Each entry is a pair of atomic words, the data and the key exclusive-ored with
+ *	the data. An entry torn by two threads writing it at once will then (almost
+ *	certainly) not match its key, and be taken as a miss. Lookups are counted
+ *	separately for each thread, so that threads don't contend over the counters.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _TRANSPOSITIONTABLE_H_
+#define _TRANSPOSITIONTABLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class TranspositionTable {
+public:
+
+	/* Kind of score stored: the exact value of the position, or a bound on it
+	 * found when the search was cut off */
+	enum Bound { NONE = 0, EXACT = 1, LOWER = 2, UPPER = 3 };
+
+	/* Result of a search, as stored in the table. The move is the index of the
+	 * best cell found, or -1 if there was none. */
+	struct Result {
+		int score;
+		int move;
+		int depth;
+		Bound bound;
+	};
+
+	/* Constructor allocates a table of (at most) the given size in megabytes */
+	TranspositionTable(size_t megabytes);
+
+	/* Changes the size of the table, clearing it */
+	void resize(size_t megabytes);
+
+	/* Empties the table, and resets its statistics. Must not be called while
+	 * other threads are using the table. */
+	void clear();
+
+	/* Sets the number of threads that will use the table, so that each has its
+	 * own lookup counters. Threads are numbered from zero. */
+	void setThreads(int threads);
+
+	/* Marks the start of a new search, making entries from older searches
+	 * the first to be replaced */
+	void newSearch();
+
+	/* Looks up the given position, for the given thread. Returns true and fills
+	 * in the result if it is in the table. */
+	bool probe(uint64_t key, Result& result, int thread = 0);
+
+	/* Stores the result of a search of the given position */
+	void store(uint64_t key, int score, int move, int depth, Bound bound);
+
+	/* Size of the table in bytes */
+	size_t size() const;
+
+	/* Number of lookups by all threads, and number of those that found their
+	 * position */
+	uint64_t probes() const;
+	uint64_t hits() const;
+
+	/* Fraction of lookups that found their position, or zero if there were none */
+	double hitRate() const;
+
+private:
+
+	/* An entry packs its result into a single word, next to the key (which
+	 * is stored exclusive-ored with the data) */
+	struct Entry {
+		std::atomic<uint64_t> key;
+		std::atomic<uint64_t> data;
+	};
+
+	/* Number of entries per bucket, chosen so a bucket fills one 64 byte
+	 * cache line */
+	static const int BUCKET_SIZE = 4;
+	static const size_t CACHE_LINE = 64;
+
+	struct Bucket {
+		Entry entries[BUCKET_SIZE];
+	};
+
+	/* Packs and unpacks the fields of an entry's data */
+	static uint64_t pack(int score, int move, int depth, Bound bound, int generation);
+	static Result unpack(uint64_t data);
+	static int generationOf(uint64_t data);
+
+	/* Returns the bucket the given position belongs in */
+	Bucket& bucketFor(uint64_t key) {
+		return buckets[key & (numBuckets - 1)];
+	}
+
+	/* Memory for the buckets, of which buckets is the first aligned to a
+	 * cache line */
+	std::unique_ptr<char[]> memory;
+	Bucket* buckets;
+	size_t numBuckets;
+
+	/* Counter of searches, kept in each entry to tell how old it is */
+	int generation;
+
+	/* Lookup counters of one thread, padded out to a cache line so that
+	 * threads don't write to the same line */
+	struct Counters {
+		Counters() : probes(0), hits(0) {}
+		uint64_t probes;
+		uint64_t hits;
+		char padding[CACHE_LINE - 2 * sizeof(uint64_t)];
+	};
+	std::vector<Counters> counters;
+
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*	WaveBoard.cpp
+ *
+ *	Implements the wave-at-a-time resolution of chain reactions. See WaveBoard.h
+ *	for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <atomic>
+
+#include "WaveBoard.h"
+
+#if defined(__x86_64__)
+#define WAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Widest vector the lanes are padded for, in bytes */
+const int VECTOR_BYTES = 32;
+
+/* Kernels for the two passes of a wave. Each works on rows 1 to rows of lanes
+ * stride bytes long, which is a multiple of the vector width. */
+typedef int (*MarkKernel)(const uint8_t* balls, const uint8_t* capacity,
+						  uint8_t* fire, int rows, int stride);
+typedef uint64_t (*SpreadKernel)(uint8_t* balls, uint8_t* owner,
+								 const uint8_t* capacity, const uint8_t* fire,
+								 int rows, int stride, PlayerId mover);
+
+/* ===== Plain kernels ===== */
+
+static int markScalar(const uint8_t* balls, const uint8_t* capacity,
+					  uint8_t* fire, int rows, int stride) {
+	int fired = 0;
+	for (int i = stride; i < (rows + 1) * stride; ++i) {
+		fire[i] = (capacity[i] != 0 && balls[i] >= capacity[i]);
+		fired += fire[i];
+	}
+	return fired;
+}
+
+static uint64_t spreadScalar(uint8_t* balls, uint8_t* owner, const uint8_t* capacity,
+							 const uint8_t* fire, int rows, int stride, PlayerId mover) {
+	uint64_t otherBalls = 0;
+	for (int i = stride; i < (rows + 1) * stride; ++i) {
+		int received = 0;
+		if (capacity[i] != 0)
+			received = fire[i - stride] + fire[i + stride] + fire[i - 1] + fire[i + 1];
+		balls[i] = balls[i] - (fire[i] ? capacity[i] : 0) + received;
+		if (received != 0)
+			owner[i] = mover;
+		else if (balls[i] == 0)
+			owner[i] = NO_PLAYER;
+		if (owner[i] != mover)
+			otherBalls += balls[i];
+	}
+	return otherBalls;
+}
+
+#ifdef WAVE_X86
+
+/* ===== SSE2 kernels, 16 cells at a time ===== */
+
+/* Cells are at capacity when their capacity isn't zero and the larger of
+ * their balls and capacity is their balls. Marks are counted with a sum of
+ * absolute differences from zero. */
+static int markSSE2(const uint8_t* balls, const uint8_t* capacity,
+					uint8_t* fire, int rows, int stride) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i sum = zero;
+	for (int i = stride; i < (rows + 1) * stride; i += 16) {
+		__m128i b = _mm_load_si128((const __m128i*)(balls + i));
+		__m128i c = _mm_load_si128((const __m128i*)(capacity + i));
+		__m128i full = _mm_cmpeq_epi8(_mm_max_epu8(b, c), b);
+		__m128i f = _mm_andnot_si128(_mm_cmpeq_epi8(c, zero), full);
+		f = _mm_and_si128(f, one);
+		_mm_store_si128((__m128i*)(fire + i), f);
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(f, zero));
+	}
+	return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+
+/* The marks of the neighbours above and below are a row away, and those of
+ * the neighbours to the left and right a byte away (unaligned loads) */
+static uint64_t spreadSSE2(uint8_t* balls, uint8_t* owner, const uint8_t* capacity,
+						   const uint8_t* fire, int rows, int stride, PlayerId mover) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i moverLanes = _mm_set1_epi8(mover);
+	__m128i sum = zero;
+	for (int i = stride; i < (rows + 1) * stride; i += 16) {
+		__m128i b = _mm_load_si128((const __m128i*)(balls + i));
+		__m128i o = _mm_load_si128((const __m128i*)(owner + i));
+		__m128i c = _mm_load_si128((const __m128i*)(capacity + i));
+		__m128i f = _mm_load_si128((const __m128i*)(fire + i));
+		__m128i received = _mm_add_epi8(
+			_mm_add_epi8(_mm_load_si128((const __m128i*)(fire + i - stride)),
+						 _mm_load_si128((const __m128i*)(fire + i + stride))),
+			_mm_add_epi8(_mm_loadu_si128((const __m128i*)(fire + i - 1)),
+						 _mm_loadu_si128((const __m128i*)(fire + i + 1))));
+		received = _mm_andnot_si128(_mm_cmpeq_epi8(c, zero), received);
+		__m128i lost = _mm_and_si128(_mm_sub_epi8(zero, f), c);
+		b = _mm_add_epi8(_mm_sub_epi8(b, lost), received);
+		__m128i kept = _mm_andnot_si128(_mm_cmpeq_epi8(b, zero), o);
+		__m128i captured = _mm_xor_si128(_mm_cmpeq_epi8(received, zero),
+										 _mm_set1_epi8(-1));
+		o = _mm_or_si128(_mm_and_si128(captured, moverLanes),
+						 _mm_andnot_si128(captured, kept));
+		_mm_store_si128((__m128i*)(balls + i), b);
+		_mm_store_si128((__m128i*)(owner + i), o);
+		__m128i others = _mm_andnot_si128(_mm_cmpeq_epi8(o, moverLanes), b);
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(others, zero));
+	}
+	return (uint64_t)_mm_cvtsi128_si64(sum) + (uint64_t)_mm_cvtsi128_si64(_mm_srli_si128(sum, 8));
+}
+
+/* ===== AVX2 kernels, 32 cells at a time ===== */
+
+__attribute__((target("avx2")))
+static int markAVX2(const uint8_t* balls, const uint8_t* capacity,
+					uint8_t* fire, int rows, int stride) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	__m256i sum = zero;
+	for (int i = stride; i < (rows + 1) * stride; i += 32) {
+		__m256i b = _mm256_load_si256((const __m256i*)(balls + i));
+		__m256i c = _mm256_load_si256((const __m256i*)(capacity + i));
+		__m256i full = _mm256_cmpeq_epi8(_mm256_max_epu8(b, c), b);
+		__m256i f = _mm256_andnot_si256(_mm256_cmpeq_epi8(c, zero), full);
+		f = _mm256_and_si256(f, one);
+		_mm256_store_si256((__m256i*)(fire + i), f);
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(f, zero));
+	}
+	__m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum),
+								 _mm256_extracti128_si256(sum, 1));
+	return _mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+}
+
+__attribute__((target("avx2")))
+static uint64_t spreadAVX2(uint8_t* balls, uint8_t* owner, const uint8_t* capacity,
+						   const uint8_t* fire, int rows, int stride, PlayerId mover) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i moverLanes = _mm256_set1_epi8(mover);
+	__m256i sum = zero;
+	for (int i = stride; i < (rows + 1) * stride; i += 32) {
+		__m256i b = _mm256_load_si256((const __m256i*)(balls + i));
+		__m256i o = _mm256_load_si256((const __m256i*)(owner + i));
+		__m256i c = _mm256_load_si256((const __m256i*)(capacity + i));
+		__m256i f = _mm256_load_si256((const __m256i*)(fire + i));
+		__m256i received = _mm256_add_epi8(
+			_mm256_add_epi8(_mm256_load_si256((const __m256i*)(fire + i - stride)),
+							_mm256_load_si256((const __m256i*)(fire + i + stride))),
+			_mm256_add_epi8(_mm256_loadu_si256((const __m256i*)(fire + i - 1)),
+							_mm256_loadu_si256((const __m256i*)(fire + i + 1))));
+		received = _mm256_andnot_si256(_mm256_cmpeq_epi8(c, zero), received);
+		__m256i lost = _mm256_and_si256(_mm256_sub_epi8(zero, f), c);
+		b = _mm256_add_epi8(_mm256_sub_epi8(b, lost), received);
+		__m256i kept = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, zero), o);
+		__m256i quiet = _mm256_cmpeq_epi8(received, zero);
+		o = _mm256_blendv_epi8(moverLanes, kept, quiet);
+		_mm256_store_si256((__m256i*)(balls + i), b);
+		_mm256_store_si256((__m256i*)(owner + i), o);
+		__m256i others = _mm256_andnot_si256(_mm256_cmpeq_epi8(o, moverLanes), b);
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(others, zero));
+	}
+	__m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum),
+								 _mm256_extracti128_si256(sum, 1));
+	return (uint64_t)_mm_cvtsi128_si64(half) + (uint64_t)_mm_cvtsi128_si64(_mm_srli_si128(half, 8));
+}
+
+#endif
+
+/* Kernels picked with WaveBoard::useKernels() */
+static std::atomic<int> chosenKernels(WaveBoard::BEST_KERNELS);
+
+/* Returns whether the processor supports the given kernels */
+static bool supported(WaveBoard::Kernels kernels) {
+	switch (kernels) {
+#ifdef WAVE_X86
+	case WaveBoard::SSE2_KERNELS:
+		return __builtin_cpu_supports("sse2");
+	case WaveBoard::AVX2_KERNELS:
+		return __builtin_cpu_supports("avx2");
+#else
+	case WaveBoard::SSE2_KERNELS:
+	case WaveBoard::AVX2_KERNELS:
+		return false;
+#endif
+	default:
+		return true;
+	}
+}
+
+/* Picks the kernels chosen with WaveBoard::useKernels(), or by default the
+ * widest the processor supports, which are found once */
+static void selectKernels(MarkKernel& mark, SpreadKernel& spread) {
+	static MarkKernel bestMark = markScalar;
+	static SpreadKernel bestSpread = spreadScalar;
+#ifdef WAVE_X86
+	static bool selected = [] {
+		if (__builtin_cpu_supports("avx2")) {
+			bestMark = markAVX2;
+			bestSpread = spreadAVX2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			bestMark = markSSE2;
+			bestSpread = spreadSSE2;
+		}
+		return true;
+	}();
+	(void)selected;
+#endif
+	mark = bestMark;
+	spread = bestSpread;
+	switch (chosenKernels.load(std::memory_order_relaxed)) {
+	case WaveBoard::SCALAR_KERNELS:
+		mark = markScalar;
+		spread = spreadScalar;
+		break;
+#ifdef WAVE_X86
+	case WaveBoard::SSE2_KERNELS:
+		mark = markSSE2;
+		spread = spreadSSE2;
+		break;
+	case WaveBoard::AVX2_KERNELS:
+		mark = markAVX2;
+		spread = spreadAVX2;
+		break;
+#endif
+	}
+}
+
+bool WaveBoard::useKernels(Kernels kernels) {
+	if (!supported(kernels))
+		return false;
+	chosenKernels.store(kernels, std::memory_order_relaxed);
+	return true;
+}
+
+/* The lanes are only reallocated when the size of the board changes. The
+ * border and padding cells are zero in every lane, and stay that way. */
+void WaveBoard::load(const Board& board) {
+	if (board.rows() != numRows || board.cols() != numCols) {
+		numRows = board.rows();
+		numCols = board.cols();
+		stride = (numCols + 2 + VECTOR_BYTES - 1) / VECTOR_BYTES * VECTOR_BYTES;
+		laneSize = (numRows + 2) * stride + VECTOR_BYTES;
+		buffer.assign(NUM_LANES * laneSize + VECTOR_BYTES, 0);
+		uint8_t* capacities = lane(CAPACITIES);
+		for (int cell = 0; cell < board.size(); ++cell) {
+			capacities[index(cell)] = board.capacity(cell);
+		}
+	}
+	uint8_t* balls = lane(BALLS);
+	uint8_t* owners = lane(OWNERS);
+	for (int cell = 0; cell < board.size(); ++cell) {
+		balls[index(cell)] = board.balls(cell);
+		owners[index(cell)] = board.owner(cell);
+	}
+}
+
+/* Marks come first, so that the wave limit and elimination are only checked
+ * while there are cells left to explode, as in ChainReaction */
+WaveBoard::Result WaveBoard::resolve(PlayerId mover, bool canEliminate, int waveLimit) {
+	Result result;
+	uint64_t otherBalls = 0;
+	for (int cell = 0; cell < numRows * numCols; ++cell) {
+		if (owner(cell) != mover)
+			otherBalls += balls(cell);
+	}
+	while (true) {
+		int fired = mark();
+		if (fired == 0)
+			break;
+		if (canEliminate && otherBalls == 0) {
+			result.eliminated = true;
+			break;
+		}
+		if (result.waves == waveLimit) {
+			result.saturated = true;
+			break;
+		}
+		++result.waves;
+		result.explosions += fired;
+		otherBalls = spread(mover);
+	}
+	return result;
+}
+
+/* ===== Private Functions =====*/
+
+/* Since every row is a whole number of vectors long, aligning the start of
+ * the lanes aligns every row */
+uint8_t* WaveBoard::lane(Lane which) {
+	uintptr_t address = (uintptr_t)buffer.data();
+	size_t offset = (VECTOR_BYTES - address % VECTOR_BYTES) % VECTOR_BYTES;
+	return buffer.data() + offset + which * laneSize;
+}
+
+const uint8_t* WaveBoard::lane(Lane which) const {
+	return const_cast<WaveBoard*>(this)->lane(which);
+}
+
+int WaveBoard::mark() {
+	MarkKernel markKernel;
+	SpreadKernel spreadKernel;
+	selectKernels(markKernel, spreadKernel);
+	return markKernel(lane(BALLS), lane(CAPACITIES), lane(FIRES), numRows, stride);
+}
+
+uint64_t WaveBoard::spread(PlayerId mover) {
+	MarkKernel markKernel;
+	SpreadKernel spreadKernel;
+	selectKernels(markKernel, spreadKernel);
+	return spreadKernel(lane(BALLS), lane(OWNERS), lane(CAPACITIES), lane(FIRES),
+						numRows, stride, mover);
+}
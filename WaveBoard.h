@@ -0,0 +1,113 @@
+/*	WaveBoard.h
+ *
+ *	This resolves chain reactions a whole wave at a time. In a wave, every cell at
+ *	capacity explodes at once, and every cell receives a ball from each of its
+ *	neighbours that exploded. Resolved that way, the board at the end of each wave is
+ *	exactly the one the cell-by-cell explosions of ChainReaction leave behind, since
+ *	the order in which the cells of a wave explode doesn't matter.
+ *
+ *	The board is copied into byte lanes (one byte per cell, for balls, owners and
+ *	capacities), with a border of empty cells of no capacity all around it, and each
+ *	row padded to a whole number of vectors. A wave is then two passes over the lanes:
+ *	one marking the cells that explode, and one adding up the balls each cell receives
+ *	from the marks above, below, left and right of it (loads shifted by a row, or by
+ *	a byte), which works on 32 cells at a time with AVX2, or 16 with SSE2. The
+ *	instruction set is picked when the program runs, and there is a plain loop for
+ *	processors with neither. Any of them may also be picked by hand, so that they can
+ *	be checked against each other (see bench/Perft.cpp).
+ *
+ *	Every pass touches the whole board, so it only pays off for chain reactions that
+ *	reach a good part of a large board, and ChainReaction only hands such ones over.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _WAVEBOARD_H_
+#define _WAVEBOARD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Board.h"
+
+class WaveBoard {
+public:
+
+	/* Outcome of resolve(): the number of explosions and waves, and whether the
+	 * chain reaction was stopped because the moving player holds every ball on
+	 * the board ("eliminated"), or because it ran into the limit on waves
+	 * ("saturated"), as in ChainReaction::CascadeStats */
+	struct Result {
+		Result() : explosions(0), waves(0), eliminated(false), saturated(false) {}
+		int explosions;
+		int waves;
+		bool eliminated;
+		bool saturated;
+	};
+
+	/* Instruction sets the passes of a wave are written for */
+	enum Kernels { SCALAR_KERNELS, SSE2_KERNELS, AVX2_KERNELS, BEST_KERNELS };
+
+	/* Makes every WaveBoard use the kernels of the given instruction set from
+	 * then on (or, for BEST_KERNELS, the widest the processor supports, as by
+	 * default). Returns false, changing nothing, if the processor doesn't
+	 * support the instruction set. */
+	static bool useKernels(Kernels kernels);
+
+	/* Copies the contents of the board into the lanes */
+	void load(const Board& board);
+
+	/* Explodes cells wave by wave, for the given player, until no cell is at
+	 * capacity. If canEliminate is set, stops before a wave once no other
+	 * player has any balls on the board. Also stops before a wave once the
+	 * given number of waves have been run. Every cell at capacity must belong
+	 * to the mover, as it does during a move. */
+	Result resolve(PlayerId mover, bool canEliminate, int waveLimit);
+
+	/* Contents of a cell, by its index on the board */
+	uint8_t balls(int cell) const { return lane(BALLS)[index(cell)]; }
+	PlayerId owner(int cell) const { return lane(OWNERS)[index(cell)]; }
+
+private:
+
+	int numRows = 0;
+	int numCols = 0;
+
+	/* Length of each row in the lanes, a multiple of the vector width */
+	int stride = 0;
+
+	/* Lanes of balls, owners and capacities, and the marks of the cells
+	 * exploding in the current wave (one for a cell that explodes, zero
+	 * otherwise), in that order */
+	enum Lane { BALLS, OWNERS, CAPACITIES, FIRES, NUM_LANES };
+
+	/* Buffer holding the lanes, each laneSize long (a multiple of the vector
+	 * width, with a vector of slack at its end). The lanes start at the first
+	 * vector boundary in the buffer. */
+	std::vector<uint8_t> buffer;
+	std::size_t laneSize = 0;
+
+	/* Returns the start of a lane */
+	uint8_t* lane(Lane which);
+	const uint8_t* lane(Lane which) const;
+
+	/* Index in the lanes of the cell with the given index on the board */
+	int index(int cell) const {
+		int row = cell / numCols;
+		return (row + 1) * stride + (cell - row * numCols) + 1;
+	}
+
+	/* First pass of a wave: marks the cells at capacity, and returns how
+	 * many there are */
+	int mark();
+
+	/* Second pass of a wave: takes the balls of each marked cell away from
+	 * it, adds those it receives from marked neighbours to every cell, and
+	 * hands cells that receive any over to the mover. Returns the number of
+	 * balls left to other players. */
+	uint64_t spread(PlayerId mover);
+
+};
+
+#endif
@@ -0,0 +1,38 @@
+/*	Zobrist.cpp
+ *
+ *	Builds the tables of Zobrist keys. See Zobrist.h for more.
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <cstddef>
+
+#include "Zobrist.h"
+
+/* Mixes a 64-bit integer into a well-distributed random-looking one.
+ * This is the finalizer of the SplitMix64 generator. */
+static uint64_t mix(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/* Each key is the mix of a unique number made up of what it stands for, so
+ * that the key for a given cell, owner and count doesn't depend on the size
+ * of the table. Player keys are numbered apart from all cell keys. */
+ZobristKeys::ZobristKeys(int cells, int players) : numOwners(players + 1),
+												 cellKeys(cells * (players + 1) * COUNTS),
+												 playerKeys(2 * (players + 1)) {
+	for (int cell = 0; cell < cells; ++cell) {
+		for (int owner = 0; owner <= players; ++owner) {
+			for (int balls = 0; balls < COUNTS; ++balls) {
+				uint64_t id = ((uint64_t(cell) << 16) | (owner << 8) | balls);
+				cellKeys[(cell * numOwners + owner) * COUNTS + balls] = mix(id);
+			}
+		}
+	}
+	for (std::size_t i = 0; i < playerKeys.size(); ++i) {
+		playerKeys[i] = mix((uint64_t(1) << 63) | i);
+	}
+}
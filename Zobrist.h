@@ -0,0 +1,63 @@
+/*	Zobrist.h
+ *
+ *	Zobrist keys for hashing ChainReaction positions. Every possible content of a
+ *	cell -- its owner and its number of balls -- on every cell of the board is given
+ *	a random 64-bit key, as is each player for being the one to move and for having
+ *	made their first move. The hash of a position is the exclusive or of the keys of
+ *	everything in it, so that it may be updated as cells change, rather than being
+ *	recomputed from the whole board.
+ *
+ *	Keys are derived from their indices by a fixed mixing function, rather than
+ *	drawn from a seeded generator, so two games of the same size always agree on
+ *	them (and can share a transposition table).
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#ifndef _ZOBRIST_H_
+#define _ZOBRIST_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Board.h"
+
+class ZobristKeys {
+public:
+
+	/* Constructor builds the table of keys for the given number of cells and
+	 * players */
+	ZobristKeys(int cells, int players);
+
+	/* Key for a cell holding the given number of balls of the given player.
+	 * An empty cell has no key (zero). */
+	uint64_t cell(int cell, PlayerId owner, int balls) const {
+		if (balls == 0)
+			return 0;
+		return cellKeys[(cell * numOwners + owner) * COUNTS + (balls % COUNTS)];
+	}
+
+	/* Key for the given player being the one to move */
+	uint64_t toMove(PlayerId player) const {
+		return playerKeys[2 * player];
+	}
+
+	/* Key for the given player having made their first move */
+	uint64_t hasMoved(PlayerId player) const {
+		return playerKeys[2 * player + 1];
+	}
+
+private:
+
+	/* Number of ball counts keyed per cell and owner. Cells below capacity
+	 * hold fewer balls than this, and only a chain reaction cut short can
+	 * leave more (which then share keys). */
+	static const int COUNTS = 2 * MAX_NEIGHBOURS;
+
+	int numOwners;
+	std::vector<uint64_t> cellKeys;
+	std::vector<uint64_t> playerKeys;
+
+};
+
+#endif
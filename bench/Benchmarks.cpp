@@ -0,0 +1,491 @@
+/*	Benchmarks.cpp
+ *
+ *	Benchmark suite for the game and its search, meant to be run on every commit so
+ *	that regressions show up as numbers rather than impressions. It measures:
+ *
+ *	- move:      playerMove throughput, on empty, mid-game and saturated boards
+ *	- cascade:   the cost of resolving a chain reaction, against its length
+ *	- waves:     moves on large saturated boards, with chain reactions resolved
+ *	             cell by cell ("cells") or by WaveBoard ("waves")
+ *	- copy:      copying a whole game
+ *	- restore:   playing and taking back a move with makeMove/unmakeMove
+ *	- snapshot:  restoring a game from its Snapshot, against a memcpy of the
+ *	             snapshot's bytes ("memcpy ns" in the detail)
+ *	- playouts:  random games played to the end, one ChainReaction at a time
+ *	             ("single"), or with BatchGame ("batch"), in games per second
+ *	- alphabeta: nodes per second of AIPlayer's search, to fixed depths
+ *
+ *	Each result is one record: the benchmark, the board, the position searched or
+ *	played on, a parameter (the chain length, search depth or snapshot bytes), the
+ *	number of operations timed, the nanoseconds per operation, and the operations per
+ *	second.
+ *	Records are printed as CSV, or as a JSON array with --json.
+ *
+ *	Usage: Benchmarks [--json] [--min-ms milliseconds]
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AIPlayer.h"
+#include "BatchGame.h"
+#include "Board.h"
+#include "ChainReaction.h"
+#include "Snapshot.h"
+
+/* Number of moves in each sequence of the move benchmark */
+static const int SEQUENCE_MOVES = 8;
+
+/* Number of sequences prepared for each position of the move benchmark */
+static const int SEQUENCES = 64;
+
+/* Minimum time each benchmark runs for, in milliseconds */
+static int minMilliseconds = 250;
+
+typedef std::chrono::steady_clock Clock;
+
+/* A single result */
+struct Record {
+	std::string benchmark;
+	std::string board;
+	std::string position;
+	int parameter;
+	uint64_t operations;
+	double nanoseconds;
+	std::string detail;
+
+	double nsPerOp() const { return operations ? nanoseconds / operations : 0; }
+	double opsPerSecond() const { return nanoseconds > 0 ? 1e9 * operations / nanoseconds : 0; }
+};
+
+static std::vector<Record> records;
+
+/* Written to by benchmarks whose work would otherwise be optimized away */
+static volatile int sink;
+
+static double elapsed(Clock::time_point start) {
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static std::string boardName(int rows, int cols) {
+	return std::to_string(rows) + "x" + std::to_string(cols);
+}
+
+/* xorshift64* generator, so that every run plays the same moves */
+static uint64_t randomState = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t nextRandom() {
+	randomState ^= randomState >> 12;
+	randomState ^= randomState << 25;
+	randomState ^= randomState >> 27;
+	return randomState * 0x2545f4914f6cdd1dULL;
+}
+
+/* Returns a random valid move for the current player, as a cell index, or
+ * -1 if there is none */
+static int randomMove(ChainReaction& game) {
+	Player* player = game.currentPlayer();
+	int count = game.numberOfValidMoves(player);
+	if (count == 0)
+		return -1;
+	int k = nextRandom() % count;
+	int move = -1;
+	game.forEachValidMove(player, [&](int row, int col) {
+		if (k-- == 0) {
+			move = row * game.getCols() + col;
+			return false;
+		}
+		return true;
+	});
+	return move;
+}
+
+static int totalBalls(ChainReaction& game, const std::vector<Player*>& players) {
+	int balls = 0;
+	for (Player* player : players) {
+		balls += game.numberOfBalls(player);
+	}
+	return balls;
+}
+
+/* Plays random moves on the game until the board holds the given fraction of
+ * the balls it can hold without a cell being at capacity. Moves that would
+ * end the game are taken back, so the position is always still being played. */
+static void fillBoard(ChainReaction& game, const std::vector<Player*>& players,
+					  double fraction) {
+	int cols = game.getCols();
+	int target = fraction * Board(game.getRows(), cols).stableBalls();
+	int failures = 0;
+	while (totalBalls(game, players) < target && failures < 64) {
+		int move = randomMove(game);
+		if (move < 0)
+			break;
+		game.makeMove(move / cols, move % cols);
+		if (game.gameOver()) {
+			game.unmakeMove();
+			++failures;
+		}
+	}
+}
+
+/* Times playerMove over prepared sequences of random moves from the position.
+ * Each sequence is replayed on a fresh copy of the position, made outside of
+ * the timed part. */
+static void benchMoves(const ChainReaction& position, int rows, int cols,
+					   const std::string& name) {
+	std::vector<std::vector<int> > sequences(SEQUENCES);
+	uint64_t explosions = 0;
+	uint64_t sequenceMoves = 0;
+	for (std::vector<int>& sequence : sequences) {
+		ChainReaction game(position);
+		while ((int)sequence.size() < SEQUENCE_MOVES && !game.gameOver()) {
+			int move = randomMove(game);
+			if (move < 0)
+				break;
+			game.makeMove(move / cols, move % cols);
+			explosions += game.lastCascade().explosions;
+			sequence.push_back(move);
+		}
+		sequenceMoves += sequence.size();
+	}
+
+	Record record = { "move", boardName(rows, cols), name, SEQUENCE_MOVES, 0, 0, "" };
+	auto start = Clock::now();
+	while (elapsed(start) < 1e6 * minMilliseconds) {
+		for (const std::vector<int>& sequence : sequences) {
+			ChainReaction game(position);
+			auto moveStart = Clock::now();
+			for (int move : sequence) {
+				game.playerMove(move / cols, move % cols, game.currentPlayer());
+			}
+			record.nanoseconds += elapsed(moveStart);
+			record.operations += sequence.size();
+		}
+	}
+	char detail[64];
+	snprintf(detail, sizeof(detail), "explosions/move=%.2f",
+			 sequenceMoves ? (double)explosions / sequenceMoves : 0);
+	record.detail = detail;
+	records.push_back(record);
+}
+
+/* Times copying the whole game */
+static void benchCopy(const ChainReaction& position, int rows, int cols,
+					  const std::string& name) {
+	Record record = { "copy", boardName(rows, cols), name, 0, 0, 0, "" };
+	auto start = Clock::now();
+	do {
+		for (int i = 0; i < 256; ++i) {
+			ChainReaction game(position);
+			sink = game.getRows();
+		}
+		record.operations += 256;
+	} while (elapsed(start) < 1e6 * minMilliseconds);
+	record.nanoseconds = elapsed(start);
+	records.push_back(record);
+}
+
+/* Times playing a random move and taking it back, for a set of moves */
+static void benchRestore(const ChainReaction& position, int rows, int cols,
+						 const std::string& name) {
+	ChainReaction game(position);
+	if (game.gameOver())
+		return;
+	std::vector<int> moves;
+	for (int i = 0; i < 64; ++i) {
+		moves.push_back(randomMove(game));
+	}
+	Record record = { "restore", boardName(rows, cols), name, 0, 0, 0, "" };
+	auto start = Clock::now();
+	do {
+		for (int move : moves) {
+			game.makeMove(move / cols, move % cols);
+			game.unmakeMove();
+		}
+		record.operations += moves.size();
+	} while (elapsed(start) < 1e6 * minMilliseconds);
+	record.nanoseconds = elapsed(start);
+	records.push_back(record);
+}
+
+/* Times restoring a game from the snapshot of the position, and copying
+ * the snapshot's bytes as a baseline */
+static void benchSnapshot(const ChainReaction& position, int rows, int cols,
+						  const std::string& name) {
+	std::vector<uint8_t> data;
+	if (!Snapshot::save(position, data))
+		return;
+	ChainReaction game(position);
+	std::vector<uint8_t> copy(data.size());
+	Record record = { "snapshot", boardName(rows, cols), name, (int)data.size(), 0, 0, "" };
+	auto start = Clock::now();
+	do {
+		for (int i = 0; i < 256; ++i) {
+			sink = Snapshot::restore(data.data(), data.size(), game);
+		}
+		record.operations += 256;
+	} while (elapsed(start) < 1e6 * minMilliseconds);
+	record.nanoseconds = elapsed(start);
+
+	uint64_t copies = 0;
+	start = Clock::now();
+	do {
+		for (int i = 0; i < 256; ++i) {
+			memcpy(copy.data(), data.data(), data.size());
+			sink = copy[i % copy.size()];
+		}
+		copies += 256;
+	} while (elapsed(start) < 1e6 * minMilliseconds);
+	char detail[64];
+	snprintf(detail, sizeof(detail), "memcpy ns %.1f", elapsed(start) / copies);
+	record.detail = detail;
+	records.push_back(record);
+}
+
+/* Times a chain reaction of the given length, on a board of a single row.
+ * The first player fills cells 1 to length with a ball each, the second
+ * player the same number of cells at the far end, with two empty cells in
+ * between. The first player then adds a ball to cell 1, which sets off
+ * every one of its cells in turn, up to the empty cells. */
+static void benchCascade(int length) {
+	int cols = 2 * length + 4;
+	Player* first = new Player("First");
+	Player* second = new Player("Second");
+	std::vector<Player*> players = {first, second};
+	ChainReaction game(1, cols, players);
+	for (int i = 0; i < length; ++i) {
+		game.makeMove(0, 1 + i);
+		game.makeMove(0, cols - 2 - i);
+	}
+
+	game.makeMove(0, 1);
+	ChainReaction::CascadeStats cascade = game.lastCascade();
+	game.unmakeMove();
+	Record record = { "cascade", boardName(1, cols), "chain", length, 0, 0, "" };
+	auto start = Clock::now();
+	do {
+		for (int i = 0; i < 64; ++i) {
+			game.makeMove(0, 1);
+			game.unmakeMove();
+		}
+		record.operations += 64;
+	} while (elapsed(start) < 1e6 * minMilliseconds);
+	record.nanoseconds = elapsed(start);
+	char detail[96];
+	snprintf(detail, sizeof(detail), "explosions=%d waves=%d ns/explosion=%.1f",
+			 cascade.explosions, cascade.waves,
+			 cascade.explosions ? record.nsPerOp() / cascade.explosions : 0);
+	record.detail = detail;
+	records.push_back(record);
+	delete first;
+	delete second;
+}
+
+/* Times playing a random move and taking it back on a large, nearly full
+ * board, where moves set off long chain reactions, with and without
+ * WaveBoard */
+static void benchWaves(int rows, int cols) {
+	Player* first = new Player("First");
+	Player* second = new Player("Second");
+	std::vector<Player*> players = {first, second};
+	ChainReaction position(rows, cols, players);
+	fillBoard(position, players, 0.95);
+	std::vector<int> moves;
+	for (int i = 0; i < 64; ++i) {
+		moves.push_back(randomMove(position));
+	}
+
+	for (int useWaves = 0; useWaves <= 1; ++useWaves) {
+		ChainReaction game(position);
+		game.useWaveBoard(useWaves);
+		uint64_t explosions = 0;
+		for (int move : moves) {
+			game.makeMove(move / cols, move % cols);
+			explosions += game.lastCascade().explosions;
+			game.unmakeMove();
+		}
+		Record record = { "waves", boardName(rows, cols), useWaves ? "waves" : "cells",
+						  0, 0, 0, "" };
+		auto start = Clock::now();
+		do {
+			for (int move : moves) {
+				game.makeMove(move / cols, move % cols);
+				game.unmakeMove();
+			}
+			record.operations += moves.size();
+		} while (elapsed(start) < 1e6 * minMilliseconds);
+		record.nanoseconds = elapsed(start);
+		char detail[64];
+		snprintf(detail, sizeof(detail), "explosions/move=%.1f",
+				 (double)explosions / moves.size());
+		record.detail = detail;
+		records.push_back(record);
+	}
+	delete first;
+	delete second;
+}
+
+/* Plays random games from an empty board to the end, first one game object
+ * at a time, then the given number of boards at a time with BatchGame */
+static void benchPlayouts(int rows, int cols, int boards) {
+	Player* first = new Player("First");
+	Player* second = new Player("Second");
+	std::vector<Player*> players = {first, second};
+	ChainReaction empty(rows, cols, players);
+
+	Record single = { "playouts", boardName(rows, cols), "single", 1, 0, 0, "" };
+	uint64_t moves = 0;
+	auto start = Clock::now();
+	do {
+		for (int i = 0; i < 16; ++i) {
+			ChainReaction game(empty);
+			while (!game.gameOver()) {
+				int move = randomMove(game);
+				if (move < 0)
+					break;
+				game.playerMove(move / cols, move % cols, game.currentPlayer());
+				++moves;
+			}
+		}
+		single.operations += 16;
+	} while (elapsed(start) < 1e6 * minMilliseconds);
+	single.nanoseconds = elapsed(start);
+	char detail[64];
+	snprintf(detail, sizeof(detail), "moves/game=%.1f", (double)moves / single.operations);
+	single.detail = detail;
+	records.push_back(single);
+
+	BatchGame batch(rows, cols, 2, boards);
+	Record batched = { "playouts", boardName(rows, cols), "batch", boards, 0, 0, "" };
+	uint64_t random = 0x9e3779b97f4a7c15ULL;
+	moves = 0;
+	start = Clock::now();
+	do {
+		batch.reset();
+		batch.playOut(random, 16 * rows * cols);
+		for (int board = 0; board < boards; ++board) {
+			moves += batch.moves(board);
+		}
+		batched.operations += boards;
+	} while (elapsed(start) < 1e6 * minMilliseconds);
+	batched.nanoseconds = elapsed(start);
+	snprintf(detail, sizeof(detail), "moves/game=%.1f", (double)moves / batched.operations);
+	batched.detail = detail;
+	records.push_back(batched);
+	delete first;
+	delete second;
+}
+
+/* Searches a mid-game position to each depth up to the given one, with
+ * new players (and so an empty transposition table) every time */
+static void benchAlphaBeta(int rows, int cols, int maxDepth) {
+	for (int depth = 1; depth <= maxDepth; ++depth) {
+		AIPlayer* first = new AIPlayer("First");
+		AIPlayer* second = new AIPlayer("Second");
+		std::vector<Player*> players = {first, second};
+		ChainReaction game(rows, cols, players);
+		randomState = 0x9e3779b97f4a7c15ULL;
+		fillBoard(game, players, 0.5);
+		ChainReaction position(game);
+
+		AIPlayer* searcher = dynamic_cast<AIPlayer*>(position.currentPlayer());
+		searcher->alphaBeta(position, SearchBudget(0, 0, depth));
+		const SearchInfo& info = searcher->lastSearch();
+		Record record = { "alphabeta", boardName(rows, cols), "mid", depth,
+						  info.nodes, 1e6 * info.milliseconds, "" };
+		records.push_back(record);
+		delete first;
+		delete second;
+	}
+}
+
+static void printCSV() {
+	printf("benchmark,board,position,parameter,operations,ns_per_op,ops_per_sec,detail\n");
+	for (const Record& record : records) {
+		printf("%s,%s,%s,%d,%llu,%.2f,%.0f,%s\n", record.benchmark.c_str(),
+			   record.board.c_str(), record.position.c_str(), record.parameter,
+			   (unsigned long long)record.operations, record.nsPerOp(),
+			   record.opsPerSecond(), record.detail.c_str());
+	}
+}
+
+static void printJSON() {
+	printf("[\n");
+	for (size_t i = 0; i < records.size(); ++i) {
+		const Record& record = records[i];
+		printf("  {\"benchmark\": \"%s\", \"board\": \"%s\", \"position\": \"%s\", "
+			   "\"parameter\": %d, \"operations\": %llu, \"ns_per_op\": %.2f, "
+			   "\"ops_per_sec\": %.0f, \"detail\": \"%s\"}%s\n",
+			   record.benchmark.c_str(), record.board.c_str(), record.position.c_str(),
+			   record.parameter, (unsigned long long)record.operations, record.nsPerOp(),
+			   record.opsPerSecond(), record.detail.c_str(),
+			   (i + 1 < records.size()) ? "," : "");
+	}
+	printf("]\n");
+}
+
+int main(int argc, char** argv) {
+	bool json = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = true;
+		} else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+			minMilliseconds = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--json] [--min-ms milliseconds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	const int sizes[][2] = { {3, 3}, {5, 5}, {8, 8}, {12, 12} };
+	for (const auto& size : sizes) {
+		int rows = size[0];
+		int cols = size[1];
+		Player* first = new Player("First");
+		Player* second = new Player("Second");
+		std::vector<Player*> players = {first, second};
+		ChainReaction empty(rows, cols, players);
+		ChainReaction mid(empty);
+		fillBoard(mid, players, 0.5);
+		ChainReaction saturated(empty);
+		fillBoard(saturated, players, 0.95);
+
+		const ChainReaction* positions[] = { &empty, &mid, &saturated };
+		const char* names[] = { "empty", "mid", "saturated" };
+		for (int i = 0; i < 3; ++i) {
+			ChainReaction position(*positions[i]);
+			benchMoves(position, rows, cols, names[i]);
+			benchCopy(position, rows, cols, names[i]);
+			benchRestore(position, rows, cols, names[i]);
+			benchSnapshot(position, rows, cols, names[i]);
+		}
+		delete first;
+		delete second;
+	}
+
+	for (int length = 1; length <= 128; length *= 2) {
+		benchCascade(length);
+	}
+
+	benchWaves(32, 32);
+	benchWaves(64, 64);
+
+	benchPlayouts(5, 5, 1024);
+	benchPlayouts(8, 8, 1024);
+
+	benchAlphaBeta(5, 5, 5);
+	benchAlphaBeta(8, 8, 4);
+
+	if (json)
+		printJSON();
+	else
+		printCSV();
+	return 0;
+}
@@ -0,0 +1,408 @@
+/*	Perft.cpp
+ *
+ *	Counts the move tree of a game to a given depth with ChainReaction::perft(), and
+ *	reports the number of nodes and the nodes per second. The position counted from
+ *	is an empty board, after any moves given with --moves.
+ *
+ *	With --divide, the count is broken down by the first move. With --verify, the
+ *	tree is also counted by a reference that plays the rules on a plain grid of
+ *	ball counts and owners, exploding cells one at a time, depth first, and that
+ *	shares no code with the game. Every move is played on a copy of the game with
+ *	playerMove() alongside it, and the two must agree on which moves are valid and
+ *	on the position each move leads to; any difference, in those or in the counts,
+ *	is reported, and makes the program fail.
+ *
+ *	Given --waves instead, it checks WaveBoard against the cell-by-cell resolution of
+ *	chain reactions: random games are played on 32x32 and 64x64 boards, each move on
+ *	two copies of the game, one with WaveBoard and one without, which must end up in
+ *	the same position (board, ball counts, evaluation terms and hash, compared by
+ *	their snapshots) after the same number of waves. This is done once with each of
+ *	WaveBoard's kernels that the processor supports.
+ *
+ *	Usage: Perft rows cols depth [--players n] [--threads n] [--divide] [--verify]
+ *	             [--moves row,col;row,col;...]
+ *	       Perft --waves [games]
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ChainReaction.h"
+#include "Snapshot.h"
+#include "WaveBoard.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* A game played by the rules alone, as the reference for --verify: a grid of
+ * ball counts and owners, with no journal, hash, masks of owned cells or move
+ * kernels. Players are numbered from 1, with 0 for an empty cell. */
+struct ReferenceGame {
+	int rows;
+	int cols;
+	int players;
+	std::vector<int> balls;
+	std::vector<int> owners;
+	unsigned alive;
+	unsigned moved;
+	int current;
+	bool over;
+
+	ReferenceGame(int rows, int cols, int players) :
+				  rows(rows), cols(cols), players(players), balls(rows * cols, 0),
+				  owners(rows * cols, 0), alive((1u << players) - 1), moved(0),
+				  current(1), over(false) {}
+
+	int capacity(int row, int col) const {
+		return (row > 0) + (row < rows - 1) + (col > 0) + (col < cols - 1);
+	}
+
+	bool isValidMove(int row, int col) const {
+		int owner = owners[row * cols + col];
+		return (owner == 0 || owner == current);
+	}
+
+	/* Places the ball and explodes cells one at a time, depth first, until
+	 * none is left at capacity. A chain reaction that has not ended after
+	 * far more explosions than any that can end would take (which is how a
+	 * board too full to ever settle shows itself) hands the game to the
+	 * mover. */
+	void play(int row, int col) {
+		int mover = current;
+		moved |= 1u << (mover - 1);
+		std::vector<int> pending = { row * cols + col };
+		++balls[pending[0]];
+		owners[pending[0]] = mover;
+		long explosions = 0;
+		long explosionLimit = 1000L * rows * cols + 1000;
+		while (!pending.empty() && explosions < explosionLimit) {
+			int cell = pending.back();
+			pending.pop_back();
+			int cellRow = cell / cols;
+			int cellCol = cell % cols;
+			int cellCapacity = capacity(cellRow, cellCol);
+			if (cellCapacity == 0 || balls[cell] < cellCapacity)
+				continue;
+			++explosions;
+			balls[cell] -= cellCapacity;
+			if (balls[cell] == 0)
+				owners[cell] = 0;
+			static const int offsets[][2] = { { -1, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 } };
+			for (const auto& offset : offsets) {
+				int nextRow = cellRow + offset[0];
+				int nextCol = cellCol + offset[1];
+				if (nextRow < 0 || nextRow >= rows || nextCol < 0 || nextCol >= cols)
+					continue;
+				int next = nextRow * cols + nextCol;
+				++balls[next];
+				owners[next] = mover;
+				pending.push_back(next);
+			}
+			pending.push_back(cell);
+		}
+		if (!pending.empty()) {
+			alive = 1u << (mover - 1);
+			current = mover;
+			over = true;
+			return;
+		}
+		for (int player = 1; player <= players; ++player) {
+			unsigned bit = 1u << (player - 1);
+			if ((moved & bit) && std::count(owners.begin(), owners.end(), player) == 0)
+				alive &= ~bit;
+		}
+		for (int i = 1; i <= players; ++i) {
+			int next = (mover - 1 + i) % players + 1;
+			if (alive & (1u << (next - 1))) {
+				current = next;
+				break;
+			}
+		}
+		over = ((alive & (alive - 1)) == 0);
+	}
+};
+
+/* Returns whether the game is in the position of the reference: the same
+ * balls and owners in every cell, and the same player to move, unless both
+ * games are over. The board is read from the game's snapshot, whose last
+ * bytes are its cells. */
+static bool samePosition(ChainReaction& game, const ReferenceGame& reference,
+						 const std::vector<Player*>& players) {
+	if (game.gameOver() != reference.over)
+		return false;
+	if (reference.over)
+		return (game.getWinner() == players[reference.current - 1]);
+	std::vector<uint8_t> snapshot;
+	if (!Snapshot::save(game, snapshot) || game.currentPlayer() != players[reference.current - 1])
+		return false;
+	const uint8_t* cells = snapshot.data() + snapshot.size() - reference.balls.size();
+	for (size_t cell = 0; cell < reference.balls.size(); ++cell) {
+		if (cells[cell] != ((reference.owners[cell] << 4) | reference.balls[cell]))
+			return false;
+	}
+	return true;
+}
+
+/* Counts the move tree of the reference, playing every move on a copy of
+ * the game with playerMove() alongside it. Counts any move that the game
+ * and the reference don't agree is valid, or that leaves them in different
+ * positions, as a mismatch. */
+static uint64_t referencePerft(const ReferenceGame& reference, ChainReaction& game,
+							   const std::vector<Player*>& players, int depth,
+							   uint64_t& mismatches) {
+	if (depth == 0)
+		return 1;
+	if (reference.over)
+		return 0;
+	uint64_t nodes = 0;
+	for (int row = 0; row < reference.rows; ++row) {
+		for (int col = 0; col < reference.cols; ++col) {
+			ChainReaction child(game);
+			bool played = child.playerMove(row, col, child.currentPlayer());
+			if (!reference.isValidMove(row, col)) {
+				mismatches += played;
+				continue;
+			}
+			ReferenceGame next(reference);
+			next.play(row, col);
+			if (!played || !samePosition(child, next, players)) {
+				++mismatches;
+				continue;
+			}
+			nodes += referencePerft(next, child, players, depth - 1, mismatches);
+		}
+	}
+	return nodes;
+}
+
+/* Sizes of board the wave check plays on, both large enough for WaveBoard,
+ * and the number of waves after which ChainReaction hands a chain reaction
+ * over to it */
+static const int WAVE_CHECK_SIZES[] = { 32, 64 };
+static const int HANDOVER_WAVES = 4;
+
+/* xorshift64 generator, seeded the same way for every check, so that each
+ * kernel is checked on the same games */
+static uint64_t nextRandom(uint64_t& state) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/* Plays the given number of random games on a board of the given size, each
+ * move on a game with WaveBoard and on one without. Returns the number of
+ * moves after which the two differ, and counts the moves played and the
+ * moves whose chain reactions lasted long enough to be handed to WaveBoard. */
+static int checkWaveGames(int size, int games, uint64_t& moves, uint64_t& handedOver) {
+	Player first("First");
+	Player second("Second");
+	std::vector<Player*> players = { &first, &second };
+	uint64_t random = 0x9e3779b97f4a7c15ULL;
+	int mismatches = 0;
+	std::vector<uint8_t> wavesSnapshot;
+	std::vector<uint8_t> cellsSnapshot;
+	for (int i = 0; i < games; ++i) {
+		ChainReaction waves(size, size, players);
+		ChainReaction cells(size, size, players);
+		waves.useWaveBoard(true);
+		cells.useWaveBoard(false);
+		while (!waves.gameOver()) {
+			Player* player = waves.currentPlayer();
+			int k = nextRandom(random) % waves.numberOfValidMoves(player);
+			int move = -1;
+			waves.forEachValidMove(player, [&](int row, int col) {
+				if (k-- == 0) {
+					move = row * size + col;
+					return false;
+				}
+				return true;
+			});
+			waves.playerMove(move / size, move % size, player);
+			cells.playerMove(move / size, move % size, cells.currentPlayer());
+			++moves;
+			if (cells.lastCascade().waves > HANDOVER_WAVES)
+				++handedOver;
+			bool wavesSaved = Snapshot::save(waves, wavesSnapshot);
+			bool cellsSaved = Snapshot::save(cells, cellsSnapshot);
+			if (wavesSaved != cellsSaved || wavesSnapshot != cellsSnapshot
+				|| waves.hash() != cells.hash() || waves.gameOver() != cells.gameOver()
+				|| waves.lastCascade().waves != cells.lastCascade().waves
+				|| waves.lastCascade().explosions != cells.lastCascade().explosions) {
+				++mismatches;
+				break;
+			}
+		}
+	}
+	return mismatches;
+}
+
+/* Runs the wave check with each kernel the processor supports. Returns the
+ * exit status of the program. */
+static int checkWaves(int games) {
+	static const struct {
+		WaveBoard::Kernels kernels;
+		const char* name;
+	} kernelSets[] = {
+		{ WaveBoard::SCALAR_KERNELS, "scalar" },
+		{ WaveBoard::SSE2_KERNELS, "SSE2" },
+		{ WaveBoard::AVX2_KERNELS, "AVX2" },
+	};
+	bool failed = false;
+	for (const auto& kernelSet : kernelSets) {
+		if (!WaveBoard::useKernels(kernelSet.kernels)) {
+			printf("%s: not supported, skipped\n", kernelSet.name);
+			continue;
+		}
+		for (int size : WAVE_CHECK_SIZES) {
+			uint64_t moves = 0;
+			uint64_t handedOver = 0;
+			int mismatches = checkWaveGames(size, games, moves, handedOver);
+			printf("%s %dx%d: %d games, %llu moves (%llu handed to WaveBoard): %s\n",
+				   kernelSet.name, size, size, games, (unsigned long long)moves,
+				   (unsigned long long)handedOver, mismatches ? "MISMATCH" : "ok");
+			failed = failed || mismatches;
+		}
+	}
+	WaveBoard::useKernels(WaveBoard::BEST_KERNELS);
+	printf(failed ? "Verification failed\n" : "Verified against cell-by-cell explosions\n");
+	return failed ? 1 : 0;
+}
+
+static void usage(const char* program) {
+	fprintf(stderr, "Usage: %s rows cols depth [--players n] [--threads n] "
+			"[--divide] [--verify] [--moves row,col;row,col;...]\n"
+			"       %s --waves [games]\n", program, program);
+}
+
+int main(int argc, char** argv) {
+	if (argc >= 2 && strcmp(argv[1], "--waves") == 0)
+		return checkWaves((argc >= 3) ? atoi(argv[2]) : 4);
+	if (argc < 4) {
+		usage(argv[0]);
+		return 1;
+	}
+	int rows = atoi(argv[1]);
+	int cols = atoi(argv[2]);
+	int depth = atoi(argv[3]);
+	int numberOfPlayers = 2;
+	int threads = 1;
+	bool divide = false;
+	bool verify = false;
+	std::string moves;
+	for (int i = 4; i < argc; ++i) {
+		if (strcmp(argv[i], "--players") == 0 && i + 1 < argc) {
+			numberOfPlayers = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--divide") == 0) {
+			divide = true;
+		} else if (strcmp(argv[i], "--verify") == 0) {
+			verify = true;
+		} else if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc) {
+			moves = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (rows < 1 || cols < 1 || depth < 0 || numberOfPlayers < 1 || numberOfPlayers > 6) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<Player*> players;
+	for (int i = 0; i < numberOfPlayers; ++i) {
+		players.push_back(new Player("Player " + std::to_string(i + 1)));
+	}
+	ChainReaction game(rows, cols, players);
+	ReferenceGame reference(rows, cols, numberOfPlayers);
+	bool failed = false;
+	std::istringstream moveStream(moves);
+	std::string move;
+	while (std::getline(moveStream, move, ';')) {
+		int row, col;
+		if (sscanf(move.c_str(), "%d,%d", &row, &col) != 2
+			|| !game.playerMove(row, col, game.currentPlayer())) {
+			fprintf(stderr, "Invalid move: %s\n", move.c_str());
+			return 1;
+		}
+		if (reference.over || !reference.isValidMove(row, col)) {
+			failed = true;
+		} else {
+			reference.play(row, col);
+			failed = failed || !samePosition(game, reference, players);
+		}
+	}
+	if (verify && failed)
+		printf("Mismatch: the moves lead to another position under the reference\n");
+
+	uint64_t nodes = 0;
+	double seconds = 0;
+	if (divide) {
+		auto start = Clock::now();
+		std::vector<ChainReaction::PerftEntry> entries = game.perftDivide(depth, threads);
+		seconds = secondsSince(start);
+		for (const ChainReaction::PerftEntry& entry : entries) {
+			printf("%d,%d: %llu", entry.row, entry.col, (unsigned long long)entry.nodes);
+			if (verify) {
+				ChainReaction child(game);
+				child.playerMove(entry.row, entry.col, child.currentPlayer());
+				ReferenceGame next(reference);
+				uint64_t mismatches = 0;
+				uint64_t expected = 0;
+				if (next.over || !next.isValidMove(entry.row, entry.col)) {
+					++mismatches;
+				} else {
+					next.play(entry.row, entry.col);
+					if (samePosition(child, next, players))
+						expected = referencePerft(next, child, players, depth - 1, mismatches);
+					else
+						++mismatches;
+				}
+				if (expected != entry.nodes || mismatches) {
+					printf(" (expected %llu, %llu moves differ)", (unsigned long long)expected,
+						   (unsigned long long)mismatches);
+					failed = true;
+				}
+			}
+			printf("\n");
+			nodes += entry.nodes;
+		}
+	} else {
+		auto start = Clock::now();
+		nodes = game.perft(depth, threads);
+		seconds = secondsSince(start);
+	}
+
+	printf("Depth %d: %llu nodes in %.3f s (%.0f nodes/s)\n", depth,
+		   (unsigned long long)nodes, seconds, seconds > 0 ? nodes / seconds : 0);
+	if (verify && !divide) {
+		uint64_t mismatches = 0;
+		uint64_t expected = referencePerft(reference, game, players, depth, mismatches);
+		if (expected != nodes || mismatches) {
+			printf("Mismatch: the reference gives %llu nodes, and %llu moves differ\n",
+				   (unsigned long long)expected, (unsigned long long)mismatches);
+			failed = true;
+		}
+	}
+	if (verify)
+		printf(failed ? "Verification failed\n" : "Verified against the reference rules\n");
+
+	for (Player* player : players) {
+		delete player;
+	}
+	return failed ? 1 : 0;
+}
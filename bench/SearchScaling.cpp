@@ -0,0 +1,76 @@
+/*	SearchScaling.cpp
+ *
+ *	Benchmark for the multi-threaded search of AIPlayer. Searches the same mid-game
+ *	position for a fixed time with 1, 2, 4, ... threads, up to the number of cores (or
+ *	the number given), and prints the nodes per second of each, and its speedup over
+ *	a single thread.
+ *
+ *	Usage: SearchScaling [rows cols [milliseconds [threads]]]
+ *
+ *	Vasco Portilheiro, 2015
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "AIPlayer.h"
+#include "ChainReaction.h"
+
+/* Number of moves played (pseudo-randomly) before the position is searched */
+static const int OPENING_MOVES = 12;
+
+/* Plays the opening moves on the given game, always the same ones for the
+ * same board, by stepping through the cells with a fixed stride */
+static void playOpening(ChainReaction& game, int rows, int cols) {
+	int cells = rows * cols;
+	int cell = 0;
+	for (int move = 0; move < OPENING_MOVES && !game.gameOver(); ++move) {
+		for (int tries = 0; tries < cells; ++tries) {
+			cell = (cell + 7) % cells;
+			if (game.currentPlayer()->move(cell / cols, cell % cols, game))
+				break;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	int rows = (argc > 2) ? atoi(argv[1]) : 8;
+	int cols = (argc > 2) ? atoi(argv[2]) : 8;
+	int milliseconds = (argc > 3) ? atoi(argv[3]) : 2000;
+	int maxThreads = (argc > 4) ? atoi(argv[4]) : std::thread::hardware_concurrency();
+	if (maxThreads < 1)
+		maxThreads = 1;
+
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	printf("%dx%d board, %d ms per search\n", rows, cols, milliseconds);
+	printf("%8s %8s %14s %14s %8s\n", "threads", "depth", "nodes", "nodes/s", "speedup");
+	double baseRate = 0;
+	for (int threads : threadCounts) {
+		AIPlayer* first = new AIPlayer("First");
+		AIPlayer* second = new AIPlayer("Second");
+		std::vector<Player*> players = {first, second};
+		ChainReaction game(rows, cols, players);
+		playOpening(game, rows, cols);
+
+		AIPlayer* searcher = dynamic_cast<AIPlayer*>(game.currentPlayer());
+		searcher->setThreads(threads);
+		searcher->alphaBeta(game, SearchBudget(milliseconds));
+		const SearchInfo& info = searcher->lastSearch();
+		double rate = info.nodes / (info.milliseconds / 1000);
+		if (threads == 1)
+			baseRate = rate;
+		printf("%8d %8d %14llu %14.0f %8.2f\n", threads, info.depth,
+			   (unsigned long long)info.nodes, rate, rate / baseRate);
+
+		delete first;
+		delete second;
+	}
+	return 0;
+}
@@ -20,38 +20,134 @@
  *	Vasco Portilheiro, 2015
  */
 
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "AIPlayer.h"
+#include "BoardRenderer.h"
+#include "BookBuilder.h"
 #include "ChainReaction.h"
 #include "colormod.h"
 #include "Command.h"
+#include "EndgameTable.h"
+#include "EngineProtocol.h"
+#include "EngineStats.h"
+#include "GameJournal.h"
+#include "MCTSPlayer.h"
+#include "OpeningBook.h"
 #include "Player.h"
+#include "Topology.h"
+#include "Tournament.h"
 
 /* If true, will try to print to terminal using ANSI-escaped colors */
 static const bool COLOR = true;
 
+/* Most frames a second drawn of games between computer players, unless
+ * given with "--fps" */
+static const int SPECTATOR_FPS = 30;
+
+/* Opening books and endgame tables given to AI players */
+typedef std::vector<std::shared_ptr<const OpeningBook> > BookList;
+typedef std::vector<std::shared_ptr<const EndgameTable> > EndgameList;
+
 /* Prototypes */
 void congradulatePlayer(Player const* player);
 void deletePlayers(std::vector<Player*>& playerList);
 void displayGreeting();
 void displayGoodbye();
 void getBoardSize(int& rows, int& cols);
-Command getCommand(Player* const player);
+Command getCommand(Player* const player, ChainReaction& game);
 int getInteger(std::string prompt, std::string reprompt);
-void getPlayers(std::vector<Player*>& playerList);
+void getPlayers(std::vector<Player*>& playerList, const BookList& books,
+				const EndgameList& endgames);
 bool getYesOrNo(std::string prompt, std::string reprompt);
 std::string integerToString(int n);
+bool isComputer(Player const* player);
 bool isQuitCommand(const std::string& command);
+std::shared_ptr<const OpeningBook> openBook(const std::string& path);
+std::shared_ptr<const EndgameTable> openEndgameTable(const std::string& path);
+std::shared_ptr<GameJournal> openJournal(const std::string& path);
+int openingBook(int argc, char** argv);
 bool parseCommand(std::string commandString, Command& command);
 bool playAgain();
 void printScores(std::vector<Player*>& playerList);
+int replayJournal(int argc, char** argv);
+int runProtocol(int argc, char** argv);
+int solveBoard(int argc, char** argv);
+int tournament(int argc, char** argv);
+bool variantAllowed(Shape shape, CapacityRule rule, bool booksOrJournal);
+
+/* This is the command-line interface for the game. Given "--tournament" as its
+ * first argument, it instead plays a tournament between computer players
+ * without prompting (see tournament() for its options), and given
+ * "--build-book" it builds an opening book (see openingBook()), given
+ * "--solve" it solves a small board (see solveBoard()), given "--replay"
+ * it reads back a journal of games (see replayJournal()), and given
+ * "--protocol" it is driven by another process through the engine protocol
+ * (see runProtocol()). Otherwise, any
+ * "--book FILE" and "--endgame FILE" arguments give opening books and endgame
+ * tables to the AI players, "--journal FILE" writes every game played
+ * to a journal, "--fps N" sets the most frames a second drawn of games
+ * between computer players, which are watched rather than played (zero for
+ * no limit), "--variant NAME" plays on a board of another shape or with fixed
+ * capacity (see Topology::parse()), and "--stats" prints the engine's
+ * statistics after each game. */
+int main(int argc, char** argv) {
 
-/* This is the command-line interface for the game */
-int main() {
+	if (argc > 1 && strcmp(argv[1], "--tournament") == 0)
+		return tournament(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--build-book") == 0)
+		return openingBook(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--solve") == 0)
+		return solveBoard(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--replay") == 0)
+		return replayJournal(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--protocol") == 0)
+		return runProtocol(argc, argv);
+
+	BookList books;
+	EndgameList endgames;
+	std::shared_ptr<GameJournal> journal;
+	int framesPerSecond = SPECTATOR_FPS;
+	bool stats = false;
+	Shape shape = GRID_SHAPE;
+	CapacityRule rule = NEIGHBOUR_CAPACITY;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--book") == 0 && i + 1 < argc) {
+			std::shared_ptr<const OpeningBook> book = openBook(argv[++i]);
+			if (!book)
+				return 1;
+			books.push_back(book);
+		} else if (strcmp(argv[i], "--endgame") == 0 && i + 1 < argc) {
+			std::shared_ptr<const EndgameTable> endgame = openEndgameTable(argv[++i]);
+			if (!endgame)
+				return 1;
+			endgames.push_back(endgame);
+		} else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {
+			journal = openJournal(argv[++i]);
+			if (!journal)
+				return 1;
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			framesPerSecond = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			stats = true;
+		} else if (strcmp(argv[i], "--variant") == 0 && i + 1 < argc) {
+			if (!Topology::parse(argv[++i], shape, rule)) {
+				std::cerr << "Unknown variant: " << argv[i] << std::endl;
+				return 1;
+			}
+		} else {
+			std::cerr << "Unknown option: " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+	if (!variantAllowed(shape, rule, !books.empty() || !endgames.empty() || journal))
+		return 1;
 
 	/* Display welcome message */
 	displayGreeting();
@@ -63,7 +159,14 @@ int main() {
 	 * of the game, this copy will persist between games, so as to store
 	 * player scores. */
 	std::vector<Player*> playerList;
-	getPlayers(playerList);
+	getPlayers(playerList, books, endgames);
+
+	/* A game between computer players only is watched: its board is redrawn
+	 * in place as moves are played, at most framesPerSecond times a second */
+	bool spectating = true;
+	for (Player* player : playerList)
+		spectating = spectating && isComputer(player);
+	BoardRenderer renderer(std::cout, COLOR, framesPerSecond);
 	
 	/* If color flag is on, assign each player a color */
 	if (COLOR) {
@@ -75,8 +178,17 @@ int main() {
 		getBoardSize(rows, cols);
 	
 		/* Create game */
-		ChainReaction game(rows, cols, playerList, COLOR);
-		std::cout << game << std::endl;
+		std::shared_ptr<const Topology> topology(new Topology(rows, cols, shape, rule));
+		ChainReaction game(topology, playerList, COLOR);
+		/* The game's moves are only recorded when there is a journal to
+		 * write them to */
+		GameRecord record(game);
+		if (spectating) {
+			renderer.reset();
+			renderer.render(game, "", true);
+		} else {
+			std::cout << game << std::endl;
+		}
 	
 		/* Loop that runs the game. Will get a command from the player,
 		 * which is either an in-bounds location to place a ball,
@@ -84,7 +196,21 @@ int main() {
 		bool gameQuit = false;
 		while (!game.gameOver()) {
 			Player* currentPlayer = game.currentPlayer();
-			Command command = getCommand(currentPlayer);
+			if (spectating) {
+				int row, col;
+				if (!currentPlayer->chooseMove(game, row, col)
+					|| !currentPlayer->move(row, col, game)) {
+					gameQuit = true;
+					break;
+				}
+				if (journal)
+					record.addMove(game, row, col);
+				renderer.render(game, currentPlayer->getName() + " plays "
+								+ integerToString(row) + "," + integerToString(col),
+								game.gameOver());
+				continue;
+			}
+			Command command = getCommand(currentPlayer, game);
 			if (command.type == Command::QUIT) {
 				gameQuit = true;
 				break;
@@ -95,6 +221,8 @@ int main() {
 				int row = command.row;
 				int col = command.col;
 				if (currentPlayer->move(row, col, game)) {
+					if (journal)
+						record.addMove(game, row, col);
 					std::cout << "Placed ball." << std::endl;
 					std::cout << game << std::endl;
 				} else {
@@ -108,7 +236,15 @@ int main() {
 			congradulatePlayer(game.getWinner());
 			game.getWinner()->win();
 		}
+		if (journal) {
+			record.finish(game);
+			journal->write(record);
+		}
 		printScores(playerList);
+		if (stats) {
+			printStats(std::cout, collectStats());
+			resetStats();
+		}
 		if (!playAgain()) {
 			break;
 		}
@@ -118,6 +254,18 @@ int main() {
 	return 0;
 }
 
+/* Opening books, endgame tables and journals hold games on the plain grid
+ * only, so they can't be used with another variant. Reports so, and returns
+ * false, if they are given with one. */
+bool variantAllowed(Shape shape, CapacityRule rule, bool booksOrJournal) {
+	if (booksOrJournal && (shape != GRID_SHAPE || rule != NEIGHBOUR_CAPACITY)) {
+		std::cerr << "Opening books, endgame tables and journals can only be used "
+				  << "on the plain grid." << std::endl;
+		return false;
+	}
+	return true;
+}
+
 /* Displays a congradulation to the given player */
 void congradulatePlayer(Player const* player) {
 	std::cout << "Congradulations " << player->color() << player->getName()
@@ -155,8 +303,15 @@ void getBoardSize(int& rows, int& cols) {
 }
 
 /* Prompts the user for a command, either a move, or quit. Will reprompt
- * until a command is given in the valid format. */ 
-Command getCommand(Player* const player) {
+ * until a command is given in the valid format. AI players are not prompted,
+ * but search the game for their move instead. */ 
+Command getCommand(Player* const player, ChainReaction& game) {
+	int row, col;
+	if (player->chooseMove(game, row, col)) {
+		std::cout << player->color() << player->getName() << player->uncolor()
+				  << " plays " << row << "," << col << std::endl;
+		return MoveCommand(row, col);
+	}
 	while (true) {
 		std::cout << player->color() << player->getName()
 				  << " (\"row,column\" or \"quit\"): " << player->uncolor();
@@ -196,8 +351,10 @@ int getInteger(std::string prompt, std::string reprompt) {
 /* Prompts the user for the number of players, and provides the option to give
  * the players' names. Pointers to these players are stored in the given playerList.
  * These are maxed out at six, if for no other reason than there are only eight
- * printable colors available to distinguish the players. */
-void getPlayers(std::vector<Player*>& playerList) {
+ * printable colors available to distinguish the players. AI players using
+ * alpha-beta search are given the opening books and endgame tables. */
+void getPlayers(std::vector<Player*>& playerList, const BookList& books,
+				const EndgameList& endgames) {
 	int numberOfPlayers = 0;
 	while (true) {
 	   numberOfPlayers = getInteger("Number of players (max 6): ", "");
@@ -217,7 +374,20 @@ void getPlayers(std::vector<Player*>& playerList) {
 		bool isAI = getYesOrNo("Make player AI? (y/n) ", "");
 		Player* player;
 		if (isAI) {
-			player = new AIPlayer(name);
+			/* Prompt user for which search the AI is to use */
+			bool isMCTS = getYesOrNo("Use Monte Carlo tree search? (y/n) ", "");
+			if (isMCTS) {
+				player = new MCTSPlayer(name);
+			} else {
+				AIPlayer* aiPlayer = new AIPlayer(name);
+				for (const auto& book : books) {
+					aiPlayer->addBook(book);
+				}
+				for (const auto& endgame : endgames) {
+					aiPlayer->addEndgameTable(endgame);
+				}
+				player = aiPlayer;
+			}
 		} else {
 			player = new Player(name);
 		}
@@ -264,10 +434,46 @@ std::string integerToString(int n) {
 	return stream.str();
 }
 
+/* Returns whether the player chooses their own moves */
+bool isComputer(Player const* player) {
+	return dynamic_cast<AIPlayer const*>(player) != nullptr
+		|| dynamic_cast<MCTSPlayer const*>(player) != nullptr;
+}
+
 bool isQuitCommand(const std::string& command) {
 	return (command == "quit");
 }
 
+/* Opens the opening book at the given path, or reports why it couldn't */
+std::shared_ptr<const OpeningBook> openBook(const std::string& path) {
+	std::shared_ptr<OpeningBook> book(new OpeningBook());
+	if (!book->open(path)) {
+		std::cerr << "Could not open opening book: " << path << std::endl;
+		return nullptr;
+	}
+	return book;
+}
+
+/* Opens the endgame table at the given path, or reports why it couldn't */
+std::shared_ptr<const EndgameTable> openEndgameTable(const std::string& path) {
+	std::shared_ptr<EndgameTable> endgame(new EndgameTable());
+	if (!endgame->open(path)) {
+		std::cerr << "Could not open endgame table: " << path << std::endl;
+		return nullptr;
+	}
+	return endgame;
+}
+
+/* Opens the journal at the given path, or reports why it couldn't */
+std::shared_ptr<GameJournal> openJournal(const std::string& path) {
+	std::shared_ptr<GameJournal> journal(new GameJournal());
+	if (!journal->open(path)) {
+		std::cerr << "Could not open journal: " << path << std::endl;
+		return nullptr;
+	}
+	return journal;
+}
+
 bool parseCommand(std::string commandString, Command& command) {
 	if (isQuitCommand(commandString)) {
 		command = QuitCommand();
@@ -296,3 +502,287 @@ void printScores(std::vector<Player*>& playerList) {
 				  << player->uncolor() << ": " << player->getScore() << std::endl;
 	}
 }
+
+/* Runs a headless tournament, with the settings given on the command line:
+ *
+ *	--games N		number of games to play (default 100)
+ *	--size RxC		dimensions of the board (default 5x5)
+ *	--variant NAME	shape and capacity rule of the board, as "grid", "torus",
+ *					"hex" or "diagonal", followed by ":fixed" for fixed
+ *					capacity (default grid)
+ *	--workers N		number of games played at once (default 1)
+ *	--hash MB		transposition table size of alpha-beta engines (default 4)
+ *	--engine SPEC	an engine, as type[:milliseconds[:nodes[:depth]]], given once
+ *					for each player (at least two)
+ *	--book FILE		an opening book for the alpha-beta engines (may be repeated)
+ *	--endgame FILE	an endgame table for the alpha-beta engines (may be repeated)
+ *	--journal FILE	a journal to write every game to
+ *	--quiet			don't report each game as it finishes
+ *	--stats			print the engine's statistics at the end (see EngineStats.h)
+ *
+ * Returns the exit status of the program. */
+int tournament(int argc, char** argv) {
+	TournamentConfig config;
+	bool quiet = false;
+	bool stats = false;
+	Shape shape = GRID_SHAPE;
+	CapacityRule rule = NEIGHBOUR_CAPACITY;
+	for (int i = 2; i < argc; ++i) {
+		std::string option = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (option == "--quiet") {
+			quiet = true;
+		} else if (option == "--stats") {
+			stats = true;
+		} else if (option == "--games" && hasValue) {
+			config.games = atoi(argv[++i]);
+		} else if (option == "--workers" && hasValue) {
+			config.workers = atoi(argv[++i]);
+		} else if (option == "--hash" && hasValue) {
+			config.hashMegabytes = atoi(argv[++i]);
+		} else if (option == "--book" && hasValue) {
+			std::shared_ptr<const OpeningBook> book = openBook(argv[++i]);
+			if (!book)
+				return 1;
+			config.books.push_back(book);
+		} else if (option == "--endgame" && hasValue) {
+			std::shared_ptr<const EndgameTable> endgame = openEndgameTable(argv[++i]);
+			if (!endgame)
+				return 1;
+			config.endgames.push_back(endgame);
+		} else if (option == "--journal" && hasValue) {
+			config.journal = openJournal(argv[++i]);
+			if (!config.journal)
+				return 1;
+		} else if (option == "--size" && hasValue) {
+			if (sscanf(argv[++i], "%dx%d", &config.rows, &config.cols) != 2
+				|| config.rows < 1 || config.cols < 1) {
+				std::cerr << "Invalid board size: " << argv[i] << std::endl;
+				return 1;
+			}
+		} else if (option == "--variant" && hasValue) {
+			if (!Topology::parse(argv[++i], shape, rule)) {
+				std::cerr << "Unknown variant: " << argv[i] << std::endl;
+				return 1;
+			}
+		} else if (option == "--engine" && hasValue) {
+			EngineConfig engine;
+			if (!parseEngine(argv[++i], engine)) {
+				std::cerr << "Invalid engine: " << argv[i] << std::endl;
+				return 1;
+			}
+			config.engines.push_back(engine);
+		} else {
+			std::cerr << "Unknown option: " << option << std::endl;
+			return 1;
+		}
+	}
+	if (config.engines.size() < 2 || config.engines.size() > 6) {
+		std::cerr << "A tournament needs between 2 and 6 engines." << std::endl;
+		return 1;
+	}
+	if (!variantAllowed(shape, rule, !config.books.empty() || !config.endgames.empty()
+						|| config.journal))
+		return 1;
+	config.topology.reset(new Topology(config.rows, config.cols, shape, rule));
+	TournamentResult result = runTournament(config, quiet ? nullptr : &std::cout);
+	printTournament(std::cout, config, result);
+	if (stats)
+		printStats(std::cout, collectStats());
+	return 0;
+}
+
+/* Builds an opening book, with the settings given on the command line after
+ * the path of the book to write:
+ *
+ *	--size RxC		dimensions of the board (default 5x5)
+ *	--players N		number of players (default 2)
+ *	--plies N		number of plies the book covers (default 2)
+ *	--budget SPEC	budget of each search, as milliseconds[:nodes[:depth]]
+ *					(default 10000 milliseconds)
+ *	--hash MB		transposition table size of each search (default 16)
+ *	--workers N		number of positions searched at once (default 1)
+ *
+ * Returns the exit status of the program. */
+int openingBook(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " --build-book FILE [options]" << std::endl;
+		return 1;
+	}
+	std::string path = argv[2];
+	BookConfig config;
+	for (int i = 3; i < argc; ++i) {
+		std::string option = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (option == "--players" && hasValue) {
+			config.players = atoi(argv[++i]);
+		} else if (option == "--plies" && hasValue) {
+			config.plies = atoi(argv[++i]);
+		} else if (option == "--hash" && hasValue) {
+			config.hashMegabytes = atoi(argv[++i]);
+		} else if (option == "--workers" && hasValue) {
+			config.workers = atoi(argv[++i]);
+		} else if (option == "--budget" && hasValue) {
+			EngineConfig engine;
+			if (!parseEngine(std::string("alphabeta:") + argv[++i], engine)) {
+				std::cerr << "Invalid budget: " << argv[i] << std::endl;
+				return 1;
+			}
+			config.budget = engine.budget;
+		} else if (option == "--size" && hasValue) {
+			if (sscanf(argv[++i], "%dx%d", &config.rows, &config.cols) != 2
+				|| config.rows < 1 || config.cols < 1) {
+				std::cerr << "Invalid board size: " << argv[i] << std::endl;
+				return 1;
+			}
+		} else {
+			std::cerr << "Unknown option: " << option << std::endl;
+			return 1;
+		}
+	}
+	if (config.players < 1 || config.players > 6) {
+		std::cerr << "A book needs between 1 and 6 players." << std::endl;
+		return 1;
+	}
+	std::vector<OpeningBook::Entry> entries = buildBook(config, &std::cout);
+	if (!OpeningBook::write(path, config.rows, config.cols, config.players, entries)) {
+		std::cerr << "Could not write opening book: " << path << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote " << entries.size() << " positions to " << path << std::endl;
+	return 0;
+}
+
+/* Solves two-player games on a small board, and writes the endgame table to
+ * the path given after "--solve". The board is given by "--size RxC"
+ * (default 3x3). Returns the exit status of the program. */
+int solveBoard(int argc, char** argv) {
+	int rows = 3;
+	int cols = 3;
+	if (argc != 3 && !(argc == 5 && strcmp(argv[3], "--size") == 0
+					   && sscanf(argv[4], "%dx%d", &rows, &cols) == 2)) {
+		std::cerr << "Usage: " << argv[0] << " --solve FILE [--size RxC]" << std::endl;
+		return 1;
+	}
+	if (rows < 1 || cols < 1
+		|| !EndgameTable::solve(rows, cols, argv[2], &std::cout)) {
+		std::cerr << "Could not solve a " << rows << "x" << cols << " board to "
+				  << argv[2] << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+/* Reads back the journal at the path given after "--replay". On its own, it
+ * streams through every game of the journal and reports how many were played,
+ * their average length, and the wins of each seat. Given "--game N", it lists
+ * the moves of the journal's Nth game instead, and given "--move M" as well,
+ * it shows the position after the first M moves of that game (found from the
+ * last snapshot before the move). Returns the exit status of the program. */
+int replayJournal(int argc, char** argv) {
+	int gameNumber = 0;
+	int moveNumber = -1;
+	bool valid = (argc >= 3);
+	for (int i = 3; valid && i < argc; ++i) {
+		if (strcmp(argv[i], "--game") == 0 && i + 1 < argc)
+			valid = (gameNumber = atoi(argv[++i])) > 0;
+		else if (strcmp(argv[i], "--move") == 0 && i + 1 < argc)
+			valid = (moveNumber = atoi(argv[++i])) >= 0;
+		else
+			valid = false;
+	}
+	if (!valid || (moveNumber >= 0 && gameNumber == 0)) {
+		std::cerr << "Usage: " << argv[0] << " --replay FILE [--game N [--move M]]"
+				  << std::endl;
+		return 1;
+	}
+	JournalReader reader;
+	if (!reader.open(argv[2])) {
+		std::cerr << "Could not open journal: " << argv[2] << std::endl;
+		return 1;
+	}
+
+	if (gameNumber == 0) {
+		uint64_t moves = 0;
+		uint64_t unfinished = 0;
+		std::vector<uint64_t> wins(MAX_PLAYERS + 1, 0);
+		while (reader.nextGame()) {
+			moves += reader.game().moves;
+			if (reader.game().winner == NO_PLAYER)
+				++unfinished;
+			else
+				++wins[reader.game().winner];
+		}
+		uint64_t games = reader.gamesRead();
+		std::cout << games << " games, " << moves << " moves";
+		if (games > 0)
+			std::cout << " (" << (double)moves / games << " a game)";
+		std::cout << std::endl;
+		for (int seat = 1; seat <= MAX_PLAYERS; ++seat) {
+			if (wins[seat] > 0)
+				std::cout << "Seat " << seat << ": " << wins[seat] << " wins" << std::endl;
+		}
+		if (unfinished > 0)
+			std::cout << "Not finished: " << unfinished << std::endl;
+		return 0;
+	}
+
+	while ((int)reader.gamesRead() < gameNumber) {
+		if (!reader.nextGame()) {
+			std::cerr << "The journal has no game " << gameNumber << std::endl;
+			return 1;
+		}
+	}
+	const JournalGame& header = reader.game();
+	std::vector<Player*> playerList;
+	for (int i = 1; i <= header.players; ++i) {
+		playerList.push_back(new Player("Player " + integerToString(i)));
+	}
+	ChainReaction game(header.rows, header.cols, playerList, COLOR);
+	int status = 0;
+	if (moveNumber >= 0) {
+		if (reader.seek(moveNumber, game)) {
+			std::cout << game << std::endl;
+		} else {
+			std::cerr << "Game " << gameNumber << " has no move " << moveNumber << std::endl;
+			status = 1;
+		}
+	} else {
+		std::cout << header.rows << "x" << header.cols << " board, " << (int)header.players
+				  << " players, " << header.moves << " moves" << std::endl;
+		JournalMove move;
+		for (int i = 1; reader.nextMove(move); ++i) {
+			std::cout << i << ". Player " << (int)move.player << " plays "
+					  << move.cell / header.cols << "," << move.cell % header.cols;
+			if (move.waves > 0)
+				std::cout << " (" << (int)move.waves << " waves)";
+			std::cout << std::endl;
+		}
+		if (header.winner != NO_PLAYER)
+			std::cout << "Player " << (int)header.winner << " won" << std::endl;
+	}
+	deletePlayers(playerList);
+	return status;
+}
+
+/* Answers the commands of the engine protocol (see EngineProtocol.h) from the
+ * standard input until "quit", without prompting. Any "--book FILE" and
+ * "--endgame FILE" arguments are given to the players, as with
+ * "setoption". */
+int runProtocol(int argc, char** argv) {
+	std::ios::sync_with_stdio(false);
+	std::cin.tie(nullptr);
+	EngineProtocol engine(std::cin, std::cout);
+	for (int i = 2; i < argc; ++i) {
+		if ((strcmp(argv[i], "--book") == 0 || strcmp(argv[i], "--endgame") == 0)
+			&& i + 1 < argc) {
+			std::string name = (strcmp(argv[i], "--book") == 0) ? "Book" : "Endgame";
+			engine.handle("setoption name " + name + " value " + argv[++i]);
+		} else {
+			std::cerr << "Unknown option: " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+	engine.run();
+	return 0;
+}